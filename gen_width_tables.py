@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+# gen_width_tables.py - generate the display width tables in my_utf8.c
+#
+# usage: python3 gen_width_tables.py [UCD directory]
+#
+# With a directory, the tables are built from EastAsianWidth.txt,
+# UnicodeData.txt (general category and bidi class) and
+# DerivedCoreProperties.txt of that Unicode Character Database. Without one,
+# Python's unicodedata module is used, which is generated from the same files
+# (unicodedata.unidata_version tells which Unicode version).
+#
+# The rules are the ones glibc uses for wcwidth (localedata/unicode-gen/
+# utf8_gen.py), so my_utf8_codepoint_width agrees with wcwidth in a UTF-8
+# locale of the same Unicode version:
+#   - East Asian Wide (W) and Fullwidth (F) characters take 2 columns
+#   - Mn, Me and Cf characters and bidi class NSM take 0 columns, except the
+#     Prepended_Concatenation_Mark characters and U+00AD (soft hyphen)
+#   - Hangul Jamo medial vowels and final consonants (U+1160..U+11FF,
+#     U+D7B0..U+D7FF) take 0 columns
+#   - U+3248..U+324F and U+4DC0..U+4DFF take 2 columns
+# Only assigned characters are listed, except that all of planes 2 and 3
+# (U+20000..U+3FFFD) are wide, as UAX #11 sets for unassigned code points there.
+# One deliberate difference: regional indicators (U+1F1E6..U+1F1FF) are wide,
+# because terminals draw them as emoji; measureColumns then counts a pair of
+# them (a flag) as one 2-column character.
+#
+# The tables between the BEGIN/END markers in my_utf8.c are replaced in place.
+
+import os
+import re
+import sys
+
+MARK_BEGIN = "// BEGIN generated width tables (gen_width_tables.py)\n"
+MARK_END = "// END generated width tables\n"
+
+
+def ucd_ranges(path):
+    """Yield (first, last, fields) for every data line of a UCD file."""
+    with open(path, encoding="utf-8") as f:
+        for line in f:
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            fields = [x.strip() for x in line.split(";")]
+            if ".." in fields[0]:
+                first, last = (int(x, 16) for x in fields[0].split(".."))
+            else:
+                first = last = int(fields[0], 16)
+            yield first, last, fields
+
+
+def load_ucd(directory):
+    wide, zero, prepended, assigned = set(), set(), set(), set()
+    version = os.path.basename(os.path.normpath(directory))
+    for first, last, fields in ucd_ranges(os.path.join(directory, "EastAsianWidth.txt")):
+        if fields[1] in ("W", "F"):
+            wide.update(range(first, last + 1))
+    with open(os.path.join(directory, "UnicodeData.txt"), encoding="utf-8") as f:
+        rangeStart = None
+        for line in f:
+            fields = line.split(";")
+            cp = int(fields[0], 16)
+            # large blocks are given as a <..., First> and <..., Last> pair
+            if fields[1].endswith(", First>"):
+                rangeStart = cp
+                continue
+            first = rangeStart if fields[1].endswith(", Last>") else cp
+            rangeStart = None
+            assigned.update(range(first, cp + 1))
+            if fields[2] in ("Mn", "Me", "Cf") or fields[4] == "NSM":
+                zero.update(range(first, cp + 1))
+    for first, last, fields in ucd_ranges(os.path.join(directory, "DerivedCoreProperties.txt")):
+        if fields[1] == "Prepended_Concatenation_Mark":
+            prepended.update(range(first, last + 1))
+    return version, wide & assigned, zero, prepended
+
+
+def load_unicodedata():
+    import unicodedata
+    wide, zero = set(), set()
+    for cp in range(0x110000):
+        ch = chr(cp)
+        if unicodedata.category(ch) == "Cn":
+            continue # unassigned (the module reports defaults for them)
+        if unicodedata.east_asian_width(ch) in ("W", "F"):
+            wide.add(cp)
+        if unicodedata.category(ch) in ("Mn", "Me", "Cf") or unicodedata.bidirectional(ch) == "NSM":
+            zero.add(cp)
+    # Prepended_Concatenation_Mark from DerivedCoreProperties.txt (the module
+    # does not expose it); unchanged from Unicode 14.0 through 15.1
+    prepended = set(range(0x0600, 0x0606)) | {0x06DD, 0x070F, 0x0890, 0x0891, 0x08E2, 0x110BD, 0x110CD}
+    return unicodedata.unidata_version, wide, zero, prepended
+
+
+def widths(wide, zero, prepended):
+    width = {cp: 2 for cp in wide}
+    for cp in zero:
+        width[cp] = 0
+    for cp in prepended | {0x00AD}:
+        width.pop(cp, None) # default width 1
+    for cp in list(range(0x1160, 0x1200)) + list(range(0xD7B0, 0xD800)):
+        width[cp] = 0
+    for cp in list(range(0x3248, 0x3250)) + list(range(0x4DC0, 0x4E00)):
+        width[cp] = 2
+    for cp in range(0x1F1E6, 0x1F200):
+        width[cp] = 2 # regional indicators, see above
+    for cp in list(range(0x20000, 0x2FFFE)) + list(range(0x30000, 0x3FFFE)):
+        width[cp] = 2 # planes 2 and 3 are wide even where unassigned (UAX #11)
+    # the C code handles everything below U+0300 without the tables
+    return {cp: w for cp, w in width.items() if cp >= 0x0300}
+
+
+def ranges(codePoints):
+    out = []
+    for cp in sorted(codePoints):
+        if out and out[-1][1] == cp - 1:
+            out[-1][1] = cp
+        else:
+            out.append([cp, cp])
+    return out
+
+
+def c_table(name, table):
+    pairs = ["{0x%04X, 0x%04X}" % (a, b) for a, b in table]
+    lines = []
+    line = "   "
+    for k, pair in enumerate(pairs):
+        item = " " + pair + ("," if k + 1 < len(pairs) else "")
+        if len(line) + len(item) > 100:
+            lines.append(line)
+            line = "   "
+        line += item
+    lines.append(line)
+    return "static const int %s[][2] = {\n%s\n};\n" % (name, "\n".join(lines))
+
+
+def main():
+    if len(sys.argv) > 1:
+        version, wide, zero, prepended = load_ucd(sys.argv[1])
+    else:
+        version, wide, zero, prepended = load_unicodedata()
+    width = widths(wide, zero, prepended)
+    zeroTable = ranges(cp for cp, w in width.items() if w == 0)
+    wideTable = ranges(cp for cp, w in width.items() if w == 2)
+
+    block = (MARK_BEGIN +
+             "// Unicode %s; regenerate instead of editing by hand\n\n" % version +
+             "// ranges of zero-width code points: combining marks (Mn, Me), format\n"
+             "// characters (Cf), non-spacing marks (bidi class NSM) and Hangul Jamo\n"
+             "// vowels and final consonants, as sorted {first, last} pairs\n" +
+             c_table("zeroWidthRanges", zeroTable) + "\n" +
+             "// ranges of double-width code points: East Asian Wide (W) and Fullwidth (F)\n"
+             "// characters, including emoji with default emoji presentation, and\n"
+             "// regional indicators\n" +
+             c_table("wideRanges", wideTable) +
+             MARK_END)
+
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "my_utf8.c")
+    with open(path, encoding="utf-8") as f:
+        source = f.read()
+    pattern = re.compile(re.escape(MARK_BEGIN) + ".*?" + re.escape(MARK_END), re.S)
+    if not pattern.search(source):
+        sys.exit("gen_width_tables.py: markers not found in my_utf8.c")
+    source = pattern.sub(lambda m: block, source)
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(source)
+    print("Unicode %s: %d zero-width ranges, %d wide ranges" % (version, len(zeroTable), len(wideTable)))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,171 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "my_utf8.h"
+
+#ifdef MY_UTF8_STATS
+#include <stdatomic.h>
+
+// counters for one entry point, written only by the thread that owns them
+typedef struct {
+    _Atomic unsigned long long calls;
+    _Atomic unsigned long long bytes;
+    _Atomic unsigned long long asciiBytes;
+    _Atomic unsigned long long multiByteBytes;
+    _Atomic unsigned long long errors;
+    _Atomic unsigned long long allocations;
+} threadCounters;
+
+// counters of one thread; kept in a list so a snapshot can add up the
+// threads that are running
+typedef struct threadStats {
+    threadCounters functions[MY_UTF8_FN_COUNT];
+    struct threadStats *next;
+} threadStats;
+
+static threadStats *allThreadStats = NULL;
+static threadStats retiredStats; // counts of the threads that have exited
+static threadStats sharedStats; // used by threads that could not allocate their own
+static int sharedStatsListed = 0;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t statsKey; // its destructor retires a thread's counters
+static int statsKeyMade = 0;
+static pthread_once_t statsKeyOnce = PTHREAD_ONCE_INIT;
+static _Thread_local threadStats *myThreadStats = NULL;
+
+// helper function to run when a thread with counters exits: adds its counts
+// to retiredStats, then takes it off the list and frees it, so threads that
+// come and go (like the anagram workers) do not make the list grow
+void retireThreadStats(void *arg) {
+    threadStats *stats = (threadStats*)arg;
+    pthread_mutex_lock(&statsLock);
+    for (int fn = 0; fn < MY_UTF8_FN_COUNT; ++fn) {
+        threadCounters *to = &retiredStats.functions[fn];
+        threadCounters *from = &stats->functions[fn];
+        to->calls += from->calls;
+        to->bytes += from->bytes;
+        to->asciiBytes += from->asciiBytes;
+        to->multiByteBytes += from->multiByteBytes;
+        to->errors += from->errors;
+        to->allocations += from->allocations;
+    }
+    for (threadStats **link = &allThreadStats; *link != NULL; link = &(*link)->next) {
+        if (*link == stats) {
+            *link = stats->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&statsLock);
+    free(stats);
+    myThreadStats = NULL; // a later destructor may still count something
+}
+
+// helper function to create statsKey once
+void makeStatsKey(void) {
+    statsKeyMade = (pthread_key_create(&statsKey, retireThreadStats) == 0);
+}
+
+// helper function to find (or create) the counters of the calling thread
+threadStats *statsForThread(void) {
+    if (myThreadStats == NULL) {
+        threadStats *stats = (threadStats*)calloc(1, sizeof(threadStats));
+        pthread_once(&statsKeyOnce, makeStatsKey);
+        if (stats != NULL && (!statsKeyMade || pthread_setspecific(statsKey, stats) != 0)) {
+            free(stats); // it could never be retired
+            stats = NULL;
+        }
+        pthread_mutex_lock(&statsLock);
+        if (stats == NULL) {
+            stats = &sharedStats;
+            if (!sharedStatsListed) { // add it to the list once
+                sharedStats.next = allThreadStats;
+                allThreadStats = &sharedStats;
+                sharedStatsListed = 1;
+            }
+        }
+        else {
+            stats->next = allThreadStats;
+            allThreadStats = stats;
+        }
+        pthread_mutex_unlock(&statsLock);
+        myThreadStats = stats;
+    }
+    return myThreadStats;
+}
+
+// helper function to add to a counter; only the owning thread writes it, so
+// a relaxed load and store is enough and avoids a locked instruction
+void statAdd(_Atomic unsigned long long *counter, unsigned long long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+// helper function to add the counters of one thread to stats
+void sumThreadStats(my_utf8_stats *stats, threadStats *t) {
+    for (int fn = 0; fn < MY_UTF8_FN_COUNT; ++fn) {
+        my_utf8_counters *total = &stats->functions[fn];
+        threadCounters *c = &t->functions[fn];
+        total->calls += atomic_load_explicit(&c->calls, memory_order_relaxed);
+        total->bytes += atomic_load_explicit(&c->bytes, memory_order_relaxed);
+        total->asciiBytes += atomic_load_explicit(&c->asciiBytes, memory_order_relaxed);
+        total->multiByteBytes += atomic_load_explicit(&c->multiByteBytes, memory_order_relaxed);
+        total->errors += atomic_load_explicit(&c->errors, memory_order_relaxed);
+        total->allocations += atomic_load_explicit(&c->allocations, memory_order_relaxed);
+    }
+}
+
+#define MY_UTF8_STAT_ADD(fn, field, n) statAdd(&statsForThread()->functions[fn].field, (n))
+#else
+// statistics are compiled out; the arguments are still "used" so locals and
+// parameters that only feed the counters do not cause warnings, and the
+// optimizer drops them
+#define MY_UTF8_STAT_ADD(fn, field, n) ((void)(fn), (void)(n))
+#endif
+
+// Returns the name of an entry point, for exporting the statistics
+const char *my_utf8_stats_name(int fn) {
+    static const char *names[MY_UTF8_FN_COUNT] = {
+        "my_utf8_encode", "my_utf8_decode", "my_utf8_check", "my_utf8_strlen",
+        "my_utf8_charat", "my_utf8_strcmp", "my_utf8_remove_whitespace",
+        "my_utf8_anagram_checker", "my_utf8_anagram_groups", "my_utf8_substr",
+        "my_utf8_truncate_bytes", "my_utf8_display_width", "my_utf8_truncate_columns",
+        "my_utf8_line_index_build", "my_utf8_line_index_update", "my_utf8_offset_convert",
+        "my_utf8_check_bytes", "my_utf8_strlen_bytes", "my_utf8_sanitize_bytes",
+        "my_utf8_rope_init", "my_utf8_rope_insert", "my_utf8_rope_delete", "my_utf8_rope_slice"
+    };
+    if (fn < 0 || fn >= MY_UTF8_FN_COUNT) {
+        return NULL;
+    }
+    return names[fn];
+}
+
+// Adds up the counters of all threads, running or exited, into stats. The
+// counters only grow, so rates can be computed from the difference between
+// two snapshots. Returns 0 on success and -1 if the library was compiled
+// without MY_UTF8_STATS (stats is then all zero).
+int my_utf8_stats_snapshot(my_utf8_stats *stats) {
+    if (stats == NULL) {
+        return -1; // Invalid input
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->kernel = MY_UTF8_KERNEL;
+
+#ifdef MY_UTF8_STATS
+    pthread_mutex_lock(&statsLock);
+    sumThreadStats(stats, &retiredStats);
+    for (threadStats *t = allThreadStats; t != NULL; t = t->next) {
+        sumThreadStats(stats, t);
+    }
+    pthread_mutex_unlock(&statsLock);
+    return 0;
+#else
+    return -1;
+#endif
+}
 
 // helper function to convert hex character to int
 int hexCharToInt(unsigned char c) {
@@ -92,14 +257,116 @@ int getUTF8CharInfo(unsigned const char *str, int index, int *currentChar, int *
     return 0; // Success
 }
 
+// helper function to count the continuation bytes (10xxxxxx) in the first
+// n bytes of a string, looking at 8 bytes at a time
+int countContinuationBytes(unsigned const char *str, int n) {
+    int count = 0;
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        memcpy(&word, str + i, 8); // safe unaligned load of 8 bytes
+
+        // a continuation byte has bit 7 set and bit 6 clear; shifting left by
+        // one lines bit 6 up with bit 7 of the same byte
+        uint64_t cont = word & ~(word << 1) & 0x8080808080808080ULL;
+
+        // move the flags down to bit 0 of each byte and add the bytes together
+        count += (int)(((cont >> 7) * 0x0101010101010101ULL) >> 56);
+    }
+
+    // count the leftover bytes one at a time
+    for (; i < n; ++i) {
+        if ((str[i] & 0xC0) == 0x80) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// helper function to find the byte offset of the character at charIndex in
+// the first len bytes of a string. Returns len if charIndex is the number of
+// characters in the string, and -1 if it is past the end.
+int utf8ByteOffset(unsigned const char *str, int len, int charIndex) {
+    int i = 0;
+
+    // skip whole 8-byte words as long as the character is not inside them
+    while (i + 8 <= len) {
+        int chars = 8 - countContinuationBytes(str + i, 8);
+        if (chars > charIndex) {
+            break; // character is inside this word
+        }
+        charIndex -= chars;
+        i += 8;
+    }
+
+    // find the exact byte one at a time
+    for (; i < len; ++i) {
+        if ((str[i] & 0xC0) != 0x80) { // start of a character
+            if (charIndex == 0) {
+                return i;
+            }
+            charIndex--;
+        }
+    }
+
+    return (charIndex == 0) ? len : -1;
+}
+
+// helper function to compare two code points (for qsort)
+int compareCodePoints(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// helper function to write the code points of a string to sig in sorted
+// order, so that anagrams get the same signature. sig needs room for one int
+// per byte of the string. Returns the number of code points, or -1 if the
+// string is not valid UTF-8.
+int utf8Signature(unsigned const char *str, int *sig) {
+    int count = 0;
+    int i = 0;
+
+    while (str[i]) {
+        int codePoint;
+        int bytes;
+        if (getUTF8CharInfo(str, i, &codePoint, &bytes) == -1) {
+            return -1; // invalid UTF-8
+        }
+        sig[count++] = codePoint;
+        i += bytes;
+    }
+
+    if (count <= 16) {
+        // insertion sort is fastest for short words
+        for (int j = 1; j < count; ++j) {
+            int cur = sig[j];
+            int k = j - 1;
+            while (k >= 0 && sig[k] > cur) {
+                sig[k + 1] = sig[k];
+                k--;
+            }
+            sig[k + 1] = cur;
+        }
+    }
+    else {
+        qsort(sig, count, sizeof(int), compareCodePoints);
+    }
+    return count;
+}
+
 // Encoding a UTF8 string, taking as input an ASCII string,
 // with UTF8 characters encoded using the Codepoint numbering
 // scheme notation, and returns a UTF8 encoded string.
 int my_utf8_encode(unsigned char *input, unsigned char *output) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ENCODE, calls, 1);
     if (input == NULL || output == NULL) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ENCODE, errors, 1);
         return -1; // Invalid
     }
 
+    unsigned char *start = input;    // start of input, for the statistics
     unsigned char *encoded = output; // pointer to output buffer
 
     while (*input) { // loop through each character in input string
@@ -152,6 +419,8 @@ int my_utf8_encode(unsigned char *input, unsigned char *output) {
                 *(encoded++) = (char)(0x80 | (codePoint & 0x3F));
             }
             else {
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_ENCODE, errors, 1);
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_ENCODE, bytes, input - start);
                 return -1; // Invalid Unicode code point
             }
         }
@@ -162,6 +431,7 @@ int my_utf8_encode(unsigned char *input, unsigned char *output) {
     }
 
     *encoded = '\0'; // Null-terminate the encoded string
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ENCODE, bytes, input - start);
     return 0; // Success
 }
 
@@ -169,6 +439,10 @@ int my_utf8_encode(unsigned char *input, unsigned char *output) {
 // representation where possible, and UTF8 character representation
 // for non-ASCII characters.
 int my_utf8_decode(unsigned char *input, unsigned char *output) {
+    unsigned char *start = input; // start of input, for the statistics
+    int multiByte = 0;            // bytes of non-ASCII characters
+
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_DECODE, calls, 1);
     while (*input) {
         if (isASCII(input)) {
             // if character is ASCII, copy as is to output
@@ -181,6 +455,8 @@ int my_utf8_decode(unsigned char *input, unsigned char *output) {
             // Check for errors in obtaining UTF-8 character information
             int info = getUTF8CharInfo(input, 0, &codePoint, &numBytes);
             if (info == -1) { // error
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_DECODE, errors, 1);
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_DECODE, bytes, input - start);
                 return -1;
             }
 
@@ -199,15 +475,23 @@ int my_utf8_decode(unsigned char *input, unsigned char *output) {
 
             output += width + 2; // Move the output pointer to the end of the codePoint
             input +=  numBytes; // Move the input pointer to the next character
+            multiByte += numBytes;
         }
     }
 
     *output = '\0'; // Null-terminate the output string
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_DECODE, bytes, input - start);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_DECODE, asciiBytes, (input - start) - multiByte);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_DECODE, multiByteBytes, multiByte);
     return 0;       // Success
 }
 
 // Validate that the input string is a valid UTF8 encoded string
 int my_utf8_check(unsigned char *string) {
+    unsigned char *start = string; // start of string, for the statistics
+    int multiByte = 0;             // bytes of multi-byte characters
+
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, calls, 1);
     while (*string) { // loop through string
         if ((*string & 0x80) == 0) {
             // single-byte character (ASCII)
@@ -220,10 +504,13 @@ int my_utf8_check(unsigned char *string) {
                 (*string & 0x1F) == 0 || // check if first byte has a valid format
                 (string[1] & 0x3F) == 0) { // check if second byte has valid format
                 // Incorrect UTF-8 sequence
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, errors, 1);
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, bytes, string - start);
                 return 0;
             }
             // move the pointer to next character after sequence
             string += 2;
+            multiByte += 2;
         }
         // check if current character = start of three-byte UTF-8 character
         else if ((*string & 0xF0) == 0xE0) {
@@ -234,10 +521,13 @@ int my_utf8_check(unsigned char *string) {
                 (string[1] & 0x3F) == 0 || // check if second byte has a valid format
                 (string[2] & 0x3F) == 0) { // check if third byte has a valid format
                 // Incorrect UTF-8 sequence
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, errors, 1);
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, bytes, string - start);
                 return 0;
             }
             // move the pointer to next character after sequence
             string += 3;
+            multiByte += 3;
         }
         // check if current character = start of four-byte UTF-8 character
         else if ((*string & 0xF8) == 0xF0) {
@@ -250,26 +540,38 @@ int my_utf8_check(unsigned char *string) {
                 (string[2] & 0x3F) == 0 || // check if third byte has a valid format
                 (string[3] & 0x3F) == 0) { // check if fourth byte has a valid format
                 // incorrect UTF-8 sequence
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, errors, 1);
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, bytes, string - start);
                 return 0;
             }
             // move the pointer to next character after sequence
             string += 4;
+            multiByte += 4;
         }
         // if code makes it to else statement, current character is invalid
         else {
             // invalid UTF-8 sequence
+            MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, errors, 1);
+            MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, bytes, string - start);
             return 0;
         }
     }
 
     // if the code makes it here, all characters are valid
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, bytes, string - start);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, asciiBytes, (string - start) - multiByte);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK, multiByteBytes, multiByte);
     return 1;
 }
 
 // Return the number of characters in a UTF8 encoded string
 int my_utf8_strlen(unsigned char *string){
     int len = 0;
+    unsigned char *start = string; // start of string, for the statistics
+    int multiByte = 0;             // bytes of multi-byte characters
+    int invalid = 0;               // invalid bytes skipped
 
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRLEN, calls, 1);
     while (*string){ // loop through string
         // extract first byte of current character
         int byte = (int)*string;
@@ -281,21 +583,29 @@ int my_utf8_strlen(unsigned char *string){
         else if ((byte & 0xE0) == 0xC0){ // two-byte character
             len++;
             string+=2;
+            multiByte += 2;
         }
         else if ((byte & 0xF0) == 0xE0){ // three-byte character
             len++;
             string += 3;
+            multiByte += 3;
         }
         else if ((byte & 0xF8) == 0xF0){ // four-byte character
             len++;
             string+=4;
+            multiByte += 4;
         }
         // if code reaches here, the current character is invalid
         else {
             // move to next character
             string++;
+            invalid++;
         }
     }
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRLEN, bytes, string - start);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRLEN, asciiBytes, (string - start) - multiByte - invalid);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRLEN, multiByteBytes, multiByte);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRLEN, errors, invalid);
     return len;
 }
 
@@ -303,7 +613,9 @@ int my_utf8_strlen(unsigned char *string){
 // If the input string is improperly encoded, this function should
 // return NULL to indicate an error.
 unsigned char *my_utf8_charat(unsigned const char *string, int index) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, calls, 1);
     if (string == NULL || index < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, errors, 1);
         return NULL;  // Invalid input (string or index)
     }
 
@@ -317,6 +629,7 @@ unsigned char *my_utf8_charat(unsigned const char *string, int index) {
                 static unsigned char result[2];
                 result[0] = string[i];
                 result[1] = '\0'; // null-terminate
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, bytes, i + 1);
                 return result;
             }
             // keep track of remaining characters to skip before next potential match
@@ -332,6 +645,7 @@ unsigned char *my_utf8_charat(unsigned const char *string, int index) {
                 result[0] = string[i];
                 result[1] = string[i+1];
                 result[2] = '\0';
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, bytes, i + 2);
                 return result;
             }
             index--;
@@ -347,6 +661,7 @@ unsigned char *my_utf8_charat(unsigned const char *string, int index) {
                 result[1] = string[i+1];
                 result[2] = string[i+2];
                 result[3] = '\0';
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, bytes, i + 3);
                 return result;
             }
             index--;
@@ -365,6 +680,7 @@ unsigned char *my_utf8_charat(unsigned const char *string, int index) {
                 result[2] = string[i+2];
                 result[3] = string[i+3];
                 result[4] = '\0';
+                MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, bytes, i + 4);
                 return result;
             }
             index--;
@@ -373,17 +689,30 @@ unsigned char *my_utf8_charat(unsigned const char *string, int index) {
         // if code reaches here, current character is invalid
         else {
             // Invalid UTF-8 character
+            MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, errors, 1);
+            MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, bytes, i);
             return NULL;
         }
         // move to next character in the string
         i++;
     }
     // Index out of bounds or invalid UTF-8 encoding
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHARAT, bytes, i);
     return NULL;
 }
 
+// helper function to record the bytes my_utf8_strcmp compared
+void strcmpStats(long ascii, long multiByte) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRCMP, bytes, ascii + multiByte);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRCMP, asciiBytes, ascii);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRCMP, multiByteBytes, multiByte);
+}
+
 // Returns whether the two strings are the same (similar result set to strcmp())
 int my_utf8_strcmp(unsigned char *string1, unsigned char *string2) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRCMP, calls, 1);
+    long ascii = 0; // bytes of both strings compared as ASCII
+    long multiByte = 0; // bytes of both strings compared as UTF-8
     while (*string1 && *string2) { // loop through both strings
         unsigned char char1 = *string1;
         unsigned char char2 = *string2;
@@ -391,11 +720,15 @@ int my_utf8_strcmp(unsigned char *string1, unsigned char *string2) {
         if (char1 < 128 && char2 < 128) {
             // Both characters are ASCII
             if (char1 != char2) {
+                strcmpStats(ascii + 2, multiByte);
                 return char1 - char2;  // normal ASCII comparison
             }
+            ascii += 2;
         }
         else {
             // At least one character is non-ASCII (UTF-8)
+            unsigned char *from1 = string1;
+            unsigned char *from2 = string2;
             while ((*string1 & 0xC0) == 0x80) {
                 string1++;  // Skip UTF-8 continuation bytes
             }
@@ -409,6 +742,7 @@ int my_utf8_strcmp(unsigned char *string1, unsigned char *string2) {
                 // compare individual bytes of UTF-8 characters
                 diff = *string1++ - *string2++;
                 if (diff != 0) {
+                    strcmpStats(ascii, multiByte + (string1 - from1) + (string2 - from2));
                     return diff; // difference found - not the same
                 }
             }
@@ -417,12 +751,15 @@ int my_utf8_strcmp(unsigned char *string1, unsigned char *string2) {
             // characters is part of a multibyte UTF-8 sequence.
             // If one string is shorter, return the difference in length
             if ((*string1 & 0xC0) == 0x80 || (*string2 & 0xC0) == 0x80) {
+                strcmpStats(ascii, multiByte + (string1 - from1) + (string2 - from2));
                 return (*string1 & 0xC0) - (*string2 & 0xC0);
             }
 
             // Compare the first non-ASCII character
             diff = *string1 - *string2;
+            multiByte += (string1 - from1) + (string2 - from2) + 2;
             if (diff != 0) {
+                strcmpStats(ascii, multiByte);
                 return diff; // difference found
             }
         }
@@ -432,6 +769,8 @@ int my_utf8_strcmp(unsigned char *string1, unsigned char *string2) {
         string2++;
     }
 
+    strcmpStats(ascii, multiByte);
+
     // Check if one string is shorter than the other
     if (*string1) {
         return 1; // string1 longer
@@ -447,7 +786,9 @@ int my_utf8_strcmp(unsigned char *string1, unsigned char *string2) {
 // EXTRA FUN FUNCTIONS:
 // Function to remove whitespace from a UTF-8 encoded string
 unsigned char* my_utf8_remove_whitespace(unsigned const char *input) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_REMOVE_WHITESPACE, calls, 1);
     if (input == NULL) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_REMOVE_WHITESPACE, errors, 1);
         return NULL;
     }
 
@@ -460,6 +801,8 @@ unsigned char* my_utf8_remove_whitespace(unsigned const char *input) {
     // Allocate memory for the result string, considering the possibility of
     // removing characters
     unsigned char *result = (unsigned char*)malloc((inputLength + 1) * sizeof(char));
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_REMOVE_WHITESPACE, allocations, 1);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_REMOVE_WHITESPACE, bytes, inputLength);
     if (result == NULL) {
         return NULL;
     }
@@ -483,7 +826,9 @@ unsigned char* my_utf8_remove_whitespace(unsigned const char *input) {
 
 // Function to check if two strings are anagrams (1 if they are, 0 if not)
 int my_utf8_anagram_checker(unsigned char *str1, unsigned char *str2) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_CHECKER, calls, 1);
     if (str1 == NULL || str2 == NULL) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_CHECKER, errors, 1);
         printf("Invalid input.\n");
         return 0;
     }
@@ -496,195 +841,2118 @@ int my_utf8_anagram_checker(unsigned char *str1, unsigned char *str2) {
         return 0; // If lengths are different, strings cannot be anagrams
     }
 
-    // Allocate memory for character count arrays
-    // Assume a maximum of 2048 characters
-    int *charCount1 = (int*)calloc(2048, sizeof(int));
-    int *charCount2 = (int*)calloc(2048, sizeof(int));
+    // Allocate memory for the sorted code points of each string
+    // (a string never has more code points than bytes)
+    int *sig1 = (int*)malloc((strlen((char *)str1) + 1) * sizeof(int));
+    int *sig2 = (int*)malloc((strlen((char *)str2) + 1) * sizeof(int));
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_CHECKER, allocations, 2);
 
     // check if memory allocation fails
-    if (charCount1 == NULL || charCount2 == NULL) {
-        free(charCount1);
-        free(charCount2);
+    if (sig1 == NULL || sig2 == NULL) {
+        free(sig1);
+        free(sig2);
         return 0;
     }
 
-    // Count the occurrence of each character in the first string
-    int i = 0;
-    while (i < len1) {
-        int currentChar;
-        int bytes;
+    // Sort the code points of both strings; anagrams give the same result
+    int count1 = utf8Signature(str1, sig1);
+    int count2 = utf8Signature(str2, sig2);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_CHECKER, bytes, strlen((char *)str1) + strlen((char *)str2));
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_CHECKER, errors, (count1 < 0) + (count2 < 0));
+    int result = (count1 >= 0 && count1 == count2 &&
+                  memcmp(sig1, sig2, count1 * sizeof(int)) == 0);
+
+    // Free the allocated memory
+    free(sig1);
+    free(sig2);
+    return result;
+}
 
-        // Check for errors in obtaining UTF-8 character information
-        if (getUTF8CharInfo(str1, i, &currentChar, &bytes) == -1) {
-            free(charCount1);
-            free(charCount2);
-            return 0;
+// state shared by the threads that compute anagram signatures and groups
+typedef struct {
+    unsigned char **words; // words to group
+    int count;             // number of words
+    int chunk;             // words handled by each signature thread
+    int partitions;        // number of hash partitions (one per thread)
+    int **arenas;          // per-thread arena holding the signatures
+    int *sigStart;         // offset of each signature in its thread's arena
+    int *sigLength;        // code points in each signature (-1 if invalid)
+    uint64_t *sigHash;     // hash of each signature
+    int *partWords;        // the words of each signature thread's chunk (valid
+                           // ones only), sorted by partition, in word order
+    int *partStart;        // for each signature thread, partitions + 1 offsets
+                           // into its part of partWords, one per partition
+    int *rep;              // first word of the group each word belongs to
+} anagramJob;
+
+// arguments for one anagram thread
+typedef struct {
+    anagramJob *job;
+    int id;     // thread number
+    int failed; // 1 if the thread ran out of memory
+} anagramTask;
+
+// helper function to compute the signatures of one thread's chunk of words
+// into that thread's arena
+void *anagramSignatureThread(void *arg) {
+    anagramTask *task = (anagramTask *)arg;
+    anagramJob *job = task->job;
+    int start = task->id * job->chunk;
+    int end = (start + job->chunk < job->count) ? start + job->chunk : job->count;
+
+    // the arena grows as needed; signatures are stored as offsets so they
+    // stay valid when it moves
+    int *arena = NULL;
+    size_t used = 0;
+    size_t capacity = 0;
+
+    for (int i = start; i < end; ++i) {
+        size_t bytes = strlen((char *)job->words[i]);
+        if (arena == NULL || used + bytes > capacity) {
+            size_t grown = (capacity > 0) ? capacity * 2 : 4096;
+            while (used + bytes > grown) {
+                grown *= 2;
+            }
+            int *moved = (int*)realloc(arena, grown * sizeof(int));
+            MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_GROUPS, allocations, 1);
+            if (moved == NULL) {
+                task->failed = 1;
+                break;
+            }
+            arena = moved;
+            capacity = grown;
         }
 
-        charCount1[currentChar]++;
-        i += bytes;
-    }
-
-    // Count the occurrence of each character in the second string
-    i = 0;
-    while (i < len2) {
-        int currentChar;
-        int bytes;
+        int length = utf8Signature(job->words[i], arena + used);
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_GROUPS, bytes, bytes);
+        job->sigStart[i] = (int)used;
+        job->sigLength[i] = length;
+        if (length < 0) {
+            continue; // invalid UTF-8 gets no group
+        }
 
-        // Check for errors in obtaining UTF-8 character information
-        if (getUTF8CharInfo(str2, i, &currentChar, &bytes) == -1) {
-            free(charCount1);
-            free(charCount2);
-            return 0;
+        // FNV-1a hash of the sorted code points
+        uint64_t hash = 14695981039346656037ULL;
+        for (int j = 0; j < length; ++j) {
+            hash = (hash ^ (uint64_t)arena[used + j]) * 1099511628211ULL;
         }
+        job->sigHash[i] = hash;
+        used += length;
+    }
+    job->arenas[task->id] = arena;
+    if (task->failed) {
+        return NULL;
+    }
 
-        charCount2[currentChar]++;
-        i += bytes;
+    // sort the chunk's words by partition (a counting sort that keeps word
+    // order), so each group thread only reads the words of its partition
+    int *offsets = job->partStart + task->id * (job->partitions + 1);
+    memset(offsets, 0, (job->partitions + 1) * sizeof(int));
+    for (int i = start; i < end; ++i) {
+        if (job->sigLength[i] >= 0) {
+            offsets[job->sigHash[i] % job->partitions + 1]++;
+        }
     }
+    for (int p = 0; p < job->partitions; ++p) {
+        offsets[p + 1] += offsets[p];
+    }
+    // fill using offsets[p] as the cursor of partition p; afterwards it holds
+    // the end of partition p, so move the offsets back up by one
+    for (int i = start; i < end; ++i) {
+        if (job->sigLength[i] >= 0) {
+            job->partWords[start + offsets[job->sigHash[i] % job->partitions]++] = i;
+        }
+    }
+    memmove(offsets + 1, offsets, job->partitions * sizeof(int));
+    offsets[0] = 0;
+    return NULL;
+}
 
-    // Compare character counts
-    for (int j = 0; j < 2048; ++j) {
-        if (charCount1[j] != charCount2[j]) {
-            free(charCount1);
-            free(charCount2);
-            return 0; // If counts differ, strings are not anagrams
+// helper function to find the group of every word whose hash falls in this
+// thread's partition, using a hash table that only this thread touches. The
+// words come from each signature thread's partWords list, which holds only
+// the words of this partition, so the work is proportional to the partition.
+void *anagramGroupThread(void *arg) {
+    anagramTask *task = (anagramTask *)arg;
+    anagramJob *job = task->job;
+    int chunks = (job->count + job->chunk - 1) / job->chunk; // signature threads that ran
+
+    // size the table for the words in this partition
+    int inPartition = 0;
+    for (int t = 0; t < chunks; ++t) {
+        const int *offsets = job->partStart + t * (job->partitions + 1);
+        inPartition += offsets[task->id + 1] - offsets[task->id];
+    }
+    int size = 16;
+    while (size < 2 * inPartition) {
+        size *= 2;
+    }
+    int *table = (int*)malloc(size * sizeof(int));
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_GROUPS, allocations, 1);
+    if (table == NULL) {
+        task->failed = 1;
+        return NULL;
+    }
+    memset(table, 0xFF, size * sizeof(int)); // all slots empty (-1)
+
+    // chunks in order, and words in order within a chunk, so the first word
+    // of every group is found first
+    for (int t = 0; t < chunks; ++t) {
+        const int *offsets = job->partStart + t * (job->partitions + 1);
+        const int *words = job->partWords + t * job->chunk;
+        for (int k = offsets[task->id]; k < offsets[task->id + 1]; ++k) {
+            int i = words[k];
+            const int *sig = job->arenas[i / job->chunk] + job->sigStart[i];
+
+            // linear probing; a matching hash is confirmed by comparing signatures
+            int slot = (int)((job->sigHash[i] / job->partitions) & (uint64_t)(size - 1));
+            while (table[slot] >= 0) {
+                int other = table[slot];
+                if (job->sigHash[other] == job->sigHash[i] && job->sigLength[other] == job->sigLength[i] &&
+                    memcmp(job->arenas[other / job->chunk] + job->sigStart[other], sig,
+                           job->sigLength[i] * sizeof(int)) == 0) {
+                    break; // same multiset of code points
+                }
+                slot = (slot + 1) & (size - 1);
+            }
+            if (table[slot] < 0) {
+                table[slot] = i; // first word of a new group
+            }
+            job->rep[i] = table[slot];
         }
     }
 
-    // Free the allocated memory and return 1 (true)
-    free(charCount1);
-    free(charCount2);
-    return 1;
+    free(table);
+    return NULL;
 }
 
-// TESTING - helper functions
-// manually compare two strings
-int compare_strings(unsigned char *str1, unsigned char *str2){
-    while (*str1 && *str2 && *str1 == *str2){
-        str1++;
-        str2++;
+// helper function to run one thread per task, running a task on the calling
+// thread if its thread cannot be started. Returns 0, or -1 if a task failed.
+int runAnagramTasks(void *(*fn)(void *), anagramTask *tasks, pthread_t *threads, int numThreads) {
+    int *started = (int*)calloc(numThreads, sizeof(int));
+    if (started == NULL) {
+        return -1;
     }
 
-    return (*str1 == '\0' && *str2 == '\0');
+    for (int t = 0; t < numThreads; ++t) {
+        tasks[t].failed = 0;
+        started[t] = (t > 0 && pthread_create(&threads[t], NULL, fn, &tasks[t]) == 0);
+    }
+    fn(&tasks[0]); // the calling thread does the first task
+    for (int t = 1; t < numThreads; ++t) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+        else {
+            fn(&tasks[t]);
+        }
+    }
+    free(started);
+
+    for (int t = 0; t < numThreads; ++t) {
+        if (tasks[t].failed) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
-// TESTING
-void test_utf8_encode(unsigned char *input, unsigned char *expected){
-    unsigned char output[100];
+// Groups a list of words into anagram groups using numThreads threads (0 for
+// one thread per processor). groupIds[i] receives the group of words[i];
+// groups are numbered in order of first appearance, and words that are not
+// valid UTF-8 get -1. Returns the number of groups, or -1 on error.
+int my_utf8_anagram_groups(unsigned char **words, int count, int numThreads, int *groupIds) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_GROUPS, calls, 1);
+    if (words == NULL || groupIds == NULL || count < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_GROUPS, errors, 1);
+        return -1; // Invalid input
+    }
+    for (int i = 0; i < count; ++i) {
+        if (words[i] == NULL) {
+            MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_GROUPS, errors, 1);
+            return -1; // Invalid input
+        }
+    }
+    if (numThreads <= 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = (processors > 0) ? (int)processors : 1;
+    }
+    if (numThreads > count) {
+        numThreads = (count > 0) ? count : 1;
+    }
 
-    int res = my_utf8_encode(input, output);
+    anagramJob job;
+    job.words = words;
+    job.count = count;
+    job.chunk = (count + numThreads - 1) / numThreads;
+    if (job.chunk == 0) {
+        job.chunk = 1;
+    }
+    job.partitions = numThreads;
+    job.arenas = (int**)calloc(numThreads, sizeof(int*));
+    job.sigStart = (int*)malloc((count + 1) * sizeof(int));
+    job.sigLength = (int*)malloc((count + 1) * sizeof(int));
+    job.sigHash = (uint64_t*)malloc((count + 1) * sizeof(uint64_t));
+    job.partWords = (int*)malloc((count + 1) * sizeof(int));
+    job.partStart = (int*)malloc(numThreads * (numThreads + 1) * sizeof(int));
+    job.rep = (int*)malloc((count + 1) * sizeof(int));
+    anagramTask *tasks = (anagramTask*)malloc(numThreads * sizeof(anagramTask));
+    pthread_t *threads = (pthread_t*)malloc(numThreads * sizeof(pthread_t));
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_GROUPS, allocations, 9);
+
+    int groups = -1;
+    if (job.arenas != NULL && job.sigStart != NULL && job.sigLength != NULL &&
+        job.sigHash != NULL && job.partWords != NULL && job.partStart != NULL &&
+        job.rep != NULL && tasks != NULL && threads != NULL) {
+        for (int t = 0; t < numThreads; ++t) {
+            tasks[t].job = &job;
+            tasks[t].id = t;
+        }
 
-    if (res == 0 && compare_strings(output, expected)){
-        printf("PASSED: Input=\"%s\", Expected=\"%s\", Output=\"%s\"\n", input, expected, output);
+        // 1. sorted code points of every word, one chunk of words per thread,
+        //    and the chunk's words sorted by hash partition
+        // 2. group lookup, one hash partition per thread
+        if (runAnagramTasks(anagramSignatureThread, tasks, threads, numThreads) == 0 &&
+            runAnagramTasks(anagramGroupThread, tasks, threads, numThreads) == 0) {
+            // 3. number the groups in order of first appearance
+            groups = 0;
+            for (int i = 0; i < count; ++i) {
+                if (job.sigLength[i] < 0) {
+                    groupIds[i] = -1;
+                    MY_UTF8_STAT_ADD(MY_UTF8_FN_ANAGRAM_GROUPS, errors, 1);
+                }
+                else if (job.rep[i] == i) {
+                    groupIds[i] = groups++;
+                }
+                else {
+                    groupIds[i] = groupIds[job.rep[i]];
+                }
+            }
+        }
     }
-    else {
-        printf("FAILED: Input=\"%s\", Expected=\"%s\", Output=\"%s\"\n", input, expected, output);
 
+    if (job.arenas != NULL) {
+        for (int t = 0; t < numThreads; ++t) {
+            free(job.arenas[t]);
+        }
     }
+    free(job.arenas);
+    free(job.sigStart);
+    free(job.sigLength);
+    free(job.sigHash);
+    free(job.partWords);
+    free(job.partStart);
+    free(job.rep);
+    free(tasks);
+    free(threads);
+    return groups;
 }
 
-void test_utf8_decode(unsigned char *input, unsigned char *expected) {
-    unsigned char output[100];
+// Decodes the character at the start of the first len bytes of str into
+// *codePoint. Unlike getUTF8CharInfo, overlong encodings, surrogates and code
+// points above U+10FFFF are rejected. Returns the number of bytes in the
+// character, 0 if the bytes are the valid start of a character that is cut off
+// at len, or -1 if they are not valid UTF-8.
+int my_utf8_decode_next(unsigned const char *str, int len, int *codePoint) {
+    if (str == NULL || codePoint == NULL || len <= 0) {
+        return 0;
+    }
 
-    int res = my_utf8_decode(input, output);
+    unsigned char first = str[0];
+    int bytes;
+    int value;
 
-    if (res == 0 && compare_strings(output, expected)) {
-        printf("PASSED: Input=\"%s\", Expected=\"%s\", Output=\"%s\"\n", input, expected, output);
-    } 
+    if (first < 0x80) { // single-byte character
+        *codePoint = first;
+        return 1;
+    }
+    else if (first >= 0xC2 && first <= 0xDF) { // two-byte character (C0, C1 are overlong)
+        bytes = 2;
+        value = first & 0x1F;
+    }
+    else if ((first & 0xF0) == 0xE0) { // three-byte character
+        bytes = 3;
+        value = first & 0x0F;
+    }
+    else if (first >= 0xF0 && first <= 0xF4) { // four-byte character (up to U+10FFFF)
+        bytes = 4;
+        value = first & 0x07;
+    }
     else {
-        printf("FAILED: Input=\"%s\", Expected=\"%s\", Output=\"%s\"\n", input, expected, output);
+        return -1; // continuation byte or invalid first byte
     }
-}
-
-void test_utf8_check(unsigned char *input, int expected){
-    int res = my_utf8_check(input);
 
-    if (res == expected){
-        printf("PASSED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
-    } 
-    else {
-        printf("FAILED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+    for (int j = 1; j < bytes; ++j) {
+        if (j >= len) {
+            return 0; // cut off, but valid so far
+        }
+        if ((str[j] & 0xC0) != 0x80) {
+            return -1; // not a continuation byte
+        }
+        // the allowed range of the second byte depends on the first byte
+        if (j == 1 && ((first == 0xE0 && str[1] < 0xA0) || // overlong
+                       (first == 0xED && str[1] > 0x9F) || // surrogate
+                       (first == 0xF0 && str[1] < 0x90) || // overlong
+                       (first == 0xF4 && str[1] > 0x8F))) { // above U+10FFFF
+            return -1;
+        }
+        value = (value << 6) | (str[j] & 0x3F);
     }
-}
 
-void test_utf8_strlen(unsigned char *input, int expected){
-    int res = my_utf8_strlen(input);
+    *codePoint = value;
+    return bytes;
+}
 
-    if (res == expected){
-        printf("PASSED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+// Validates the first len bytes of a string (which may contain null bytes).
+// Returns the length of the longest valid prefix, so the result is len if the
+// whole string is valid UTF-8. A character cut off at len counts as invalid.
+// Returns -1 on invalid input.
+int my_utf8_check_bytes(unsigned const char *str, int len) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK_BYTES, calls, 1);
+    if (str == NULL || len < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK_BYTES, errors, 1);
+        return -1; // Invalid input
     }
-    else {
-        printf("FAILED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+
+    int i = 0;
+    int bulk = 0; // bytes skipped 8 at a time
+    while (i < len) {
+        // skip 8 ASCII bytes at once
+        if (i + 8 <= len) {
+            uint64_t word;
+            memcpy(&word, str + i, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                bulk += 8;
+                continue;
+            }
+        }
+
+        int codePoint;
+        int bytes = my_utf8_decode_next(str + i, len - i, &codePoint);
+        if (bytes <= 0) {
+            MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK_BYTES, errors, 1);
+            break; // invalid or cut off character
+        }
+        i += bytes;
     }
+
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK_BYTES, bytes, i);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK_BYTES, asciiBytes, bulk);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_CHECK_BYTES, multiByteBytes, i - bulk);
+    return i;
 }
 
-void test_utf8_charat(unsigned char *input, int index, unsigned char *expected){
-    unsigned char *res = my_utf8_charat(input, index);
+// Returns the number of characters in the first len bytes of a string (which
+// may contain null bytes), counting every byte that is not a continuation
+// byte. Returns -1 on invalid input.
+int my_utf8_strlen_bytes(unsigned const char *str, int len) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRLEN_BYTES, calls, 1);
+    if (str == NULL || len < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_STRLEN_BYTES, errors, 1);
+        return -1; // Invalid input
+    }
 
-    if (res != NULL){
-        printf("PASSED: Input=\"%s\", Index=%d, Expected=%s, Result=%s\n", input, index, expected, res);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_STRLEN_BYTES, bytes, len);
+    return len - countContinuationBytes(str, len);
+}
+
+// Copies the first len bytes of a string to output, replacing every byte that
+// is not part of a valid UTF-8 character with U+FFFD (the replacement
+// character). output needs room for 3 * len bytes and is not null-terminated.
+// Returns the number of bytes written, or -1 on invalid input.
+int my_utf8_sanitize_bytes(unsigned const char *str, int len, unsigned char *output) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_SANITIZE_BYTES, calls, 1);
+    if (str == NULL || output == NULL || len < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_SANITIZE_BYTES, errors, 1);
+        return -1; // Invalid input
     }
-    else {
-        if (expected == NULL){
-            printf("PASSED: Input=\"%s\", Index=%d, Expected=NULL, Result=NULL\n", input, index);
+
+    int i = 0;
+    int out = 0;
+    int bulk = 0; // bytes copied 8 at a time
+    int replaced = 0;
+    while (i < len) {
+        // copy 8 ASCII bytes at once
+        if (i + 8 <= len) {
+            uint64_t word;
+            memcpy(&word, str + i, 8);
+            if ((word & 0x8080808080808080ULL) == 0) {
+                memcpy(output + out, &word, 8);
+                i += 8;
+                out += 8;
+                bulk += 8;
+                continue;
+            }
+        }
+
+        int codePoint;
+        int bytes = my_utf8_decode_next(str + i, len - i, &codePoint);
+        if (bytes > 0) {
+            memcpy(output + out, str + i, bytes); // valid character, copy as is
+            i += bytes;
+            out += bytes;
         }
         else {
-            printf("FAILED: Input=\"%s\", Index=%d, Expected=%s, Result=%s\n", input, index, expected, res);
+            // replace the bad byte with U+FFFD
+            output[out++] = 0xEF;
+            output[out++] = 0xBF;
+            output[out++] = 0xBD;
+            i++;
+            replaced++;
         }
     }
-}
 
-void test_utf8_strcmp(unsigned char *string1, unsigned char *string2, int expected){
-    int res = my_utf8_strcmp(string1, string2);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_SANITIZE_BYTES, bytes, len);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_SANITIZE_BYTES, asciiBytes, bulk);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_SANITIZE_BYTES, multiByteBytes, len - bulk);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_SANITIZE_BYTES, errors, replaced);
+    return out;
+}
 
-    int sign = (res > 0) - (res < 0); // determine sign of result
+// Returns a view of charCount characters starting at character charStart,
+// pointing into the input string (nothing is copied). len is the length of
+// the string in bytes, or -1 if the string is null-terminated. If charCount
+// goes past the end of the string, the view stops at the end of the string.
+// If the input is invalid or charStart is past the end, data is NULL.
+my_utf8_view my_utf8_substr(unsigned const char *str, int len, int charStart, int charCount) {
+    my_utf8_view view = {NULL, 0};
+
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_SUBSTR, calls, 1);
+    if (str == NULL || charStart < 0 || charCount < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_SUBSTR, errors, 1);
+        return view; // Invalid input
+    }
+    if (len < 0) {
+        len = (int)strlen((const char *)str);
+    }
 
-    if (sign == expected){
-        printf("PASSED: String 1=\"%s\", String 2=\"%s\", Expected=%d, Result=%d\n", string1, string2, expected, sign);
+    // byte offset of the first character
+    int start = utf8ByteOffset(str, len, charStart);
+    if (start < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_SUBSTR, errors, 1);
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_SUBSTR, bytes, len);
+        return view; // charStart out of bounds
     }
-    else {
-        printf("FAILED: String 1=\"%s\", String 2=\"%s\", Expected=%d, Result=%d\n", string1, string2, expected, sign);
+
+    // byte offset of the end, counted from the first character
+    int end = utf8ByteOffset(str + start, len - start, charCount);
+    if (end < 0) {
+        end = len - start; // clamp to the end of the string
     }
-}
 
-void test_utf8_remove_whitespace(const unsigned char *input, unsigned char *expected) {
-    unsigned char *result = my_utf8_remove_whitespace(input);
+    view.data = str + start;
+    view.bytes = end;
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_SUBSTR, bytes, start + end);
+    return view;
+}
 
-    if (result == NULL) {
-        printf("FAILED: Input=\"%s\", Expected=\"%s\", Result=NULL\n", input, expected);
-        return;
+// Returns the number of bytes to keep so that the string fits in maxBytes
+// bytes without cutting a UTF-8 character in half. Returns -1 on invalid input.
+int my_utf8_truncate_bytes(unsigned const char *str, int maxBytes) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_TRUNCATE_BYTES, calls, 1);
+    if (str == NULL || maxBytes < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_TRUNCATE_BYTES, errors, 1);
+        return -1; // Invalid input
     }
 
-    if (compare_strings(result, expected) == 1) {
-        printf("PASSED: Input=\"%s\", Expected=\"%s\", Result=\"%s\"\n", input, expected, result);
+    // look for the end of the string, but never past maxBytes
+    int len = 0;
+    while (len < maxBytes && str[len]) {
+        len++;
     }
-    else {
-        printf("FAILED: Input=\"%s\", Expected=\"%s\", Result=\"%s\"\n", input, expected, result);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_TRUNCATE_BYTES, bytes, len);
+    if (str[len] == '\0') {
+        return len; // whole string fits
     }
 
-    free(result);
+    // str[len] is the first byte that gets cut; if it is a continuation byte,
+    // look back at most 3 bytes for the first byte of its character, and drop
+    // the character whole only if it really reaches past len (stray
+    // continuation bytes do not take the characters before them along)
+    if ((str[len] & 0xC0) != 0x80) {
+        return len;
+    }
+    for (int back = 1; back <= 3 && back <= len; ++back) {
+        unsigned char c = str[len - back];
+        if ((c & 0xC0) == 0x80) {
+            continue; // continuation byte, keep looking
+        }
+        int need = (c >= 0xF0) ? 4 : (c >= 0xE0) ? 3 : (c >= 0xC0) ? 2 : 1;
+        return (need > back) ? len - back : len;
+    }
+    return len;
 }
 
-void test_utf8_anagram_checker(unsigned char* str1, unsigned char* str2, int expected){
-    int res = my_utf8_anagram_checker(str1, str2);
+// BEGIN generated width tables (gen_width_tables.py)
+// Unicode 14.0.0; regenerate instead of editing by hand
+
+// ranges of zero-width code points: combining marks (Mn, Me), format
+// characters (Cf), non-spacing marks (bidi class NSM) and Hangul Jamo
+// vowels and final consonants, as sorted {first, last} pairs
+static const int zeroWidthRanges[][2] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+    {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x061C, 0x061C}, {0x064B, 0x065F},
+    {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED},
+    {0x0711, 0x0711}, {0x0730, 0x074A}, {0x07A6, 0x07B0}, {0x07EB, 0x07F3}, {0x07FD, 0x07FD},
+    {0x0816, 0x0819}, {0x081B, 0x0823}, {0x0825, 0x0827}, {0x0829, 0x082D}, {0x0859, 0x085B},
+    {0x0898, 0x089F}, {0x08CA, 0x08E1}, {0x08E3, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C},
+    {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0981, 0x0981},
+    {0x09BC, 0x09BC}, {0x09C1, 0x09C4}, {0x09CD, 0x09CD}, {0x09E2, 0x09E3}, {0x09FE, 0x09FE},
+    {0x0A01, 0x0A02}, {0x0A3C, 0x0A3C}, {0x0A41, 0x0A42}, {0x0A47, 0x0A48}, {0x0A4B, 0x0A4D},
+    {0x0A51, 0x0A51}, {0x0A70, 0x0A71}, {0x0A75, 0x0A75}, {0x0A81, 0x0A82}, {0x0ABC, 0x0ABC},
+    {0x0AC1, 0x0AC5}, {0x0AC7, 0x0AC8}, {0x0ACD, 0x0ACD}, {0x0AE2, 0x0AE3}, {0x0AFA, 0x0AFF},
+    {0x0B01, 0x0B01}, {0x0B3C, 0x0B3C}, {0x0B3F, 0x0B3F}, {0x0B41, 0x0B44}, {0x0B4D, 0x0B4D},
+    {0x0B55, 0x0B56}, {0x0B62, 0x0B63}, {0x0B82, 0x0B82}, {0x0BC0, 0x0BC0}, {0x0BCD, 0x0BCD},
+    {0x0C00, 0x0C00}, {0x0C04, 0x0C04}, {0x0C3C, 0x0C3C}, {0x0C3E, 0x0C40}, {0x0C46, 0x0C48},
+    {0x0C4A, 0x0C4D}, {0x0C55, 0x0C56}, {0x0C62, 0x0C63}, {0x0C81, 0x0C81}, {0x0CBC, 0x0CBC},
+    {0x0CBF, 0x0CBF}, {0x0CC6, 0x0CC6}, {0x0CCC, 0x0CCD}, {0x0CE2, 0x0CE3}, {0x0D00, 0x0D01},
+    {0x0D3B, 0x0D3C}, {0x0D41, 0x0D44}, {0x0D4D, 0x0D4D}, {0x0D62, 0x0D63}, {0x0D81, 0x0D81},
+    {0x0DCA, 0x0DCA}, {0x0DD2, 0x0DD4}, {0x0DD6, 0x0DD6}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A},
+    {0x0E47, 0x0E4E}, {0x0EB1, 0x0EB1}, {0x0EB4, 0x0EBC}, {0x0EC8, 0x0ECD}, {0x0F18, 0x0F19},
+    {0x0F35, 0x0F35}, {0x0F37, 0x0F37}, {0x0F39, 0x0F39}, {0x0F71, 0x0F7E}, {0x0F80, 0x0F84},
+    {0x0F86, 0x0F87}, {0x0F8D, 0x0F97}, {0x0F99, 0x0FBC}, {0x0FC6, 0x0FC6}, {0x102D, 0x1030},
+    {0x1032, 0x1037}, {0x1039, 0x103A}, {0x103D, 0x103E}, {0x1058, 0x1059}, {0x105E, 0x1060},
+    {0x1071, 0x1074}, {0x1082, 0x1082}, {0x1085, 0x1086}, {0x108D, 0x108D}, {0x109D, 0x109D},
+    {0x1160, 0x11FF}, {0x135D, 0x135F}, {0x1712, 0x1714}, {0x1732, 0x1733}, {0x1752, 0x1753},
+    {0x1772, 0x1773}, {0x17B4, 0x17B5}, {0x17B7, 0x17BD}, {0x17C6, 0x17C6}, {0x17C9, 0x17D3},
+    {0x17DD, 0x17DD}, {0x180B, 0x180F}, {0x1885, 0x1886}, {0x18A9, 0x18A9}, {0x1920, 0x1922},
+    {0x1927, 0x1928}, {0x1932, 0x1932}, {0x1939, 0x193B}, {0x1A17, 0x1A18}, {0x1A1B, 0x1A1B},
+    {0x1A56, 0x1A56}, {0x1A58, 0x1A5E}, {0x1A60, 0x1A60}, {0x1A62, 0x1A62}, {0x1A65, 0x1A6C},
+    {0x1A73, 0x1A7C}, {0x1A7F, 0x1A7F}, {0x1AB0, 0x1ACE}, {0x1B00, 0x1B03}, {0x1B34, 0x1B34},
+    {0x1B36, 0x1B3A}, {0x1B3C, 0x1B3C}, {0x1B42, 0x1B42}, {0x1B6B, 0x1B73}, {0x1B80, 0x1B81},
+    {0x1BA2, 0x1BA5}, {0x1BA8, 0x1BA9}, {0x1BAB, 0x1BAD}, {0x1BE6, 0x1BE6}, {0x1BE8, 0x1BE9},
+    {0x1BED, 0x1BED}, {0x1BEF, 0x1BF1}, {0x1C2C, 0x1C33}, {0x1C36, 0x1C37}, {0x1CD0, 0x1CD2},
+    {0x1CD4, 0x1CE0}, {0x1CE2, 0x1CE8}, {0x1CED, 0x1CED}, {0x1CF4, 0x1CF4}, {0x1CF8, 0x1CF9},
+    {0x1DC0, 0x1DFF}, {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x2066, 0x206F},
+    {0x20D0, 0x20F0}, {0x2CEF, 0x2CF1}, {0x2D7F, 0x2D7F}, {0x2DE0, 0x2DFF}, {0x302A, 0x302D},
+    {0x3099, 0x309A}, {0xA66F, 0xA672}, {0xA674, 0xA67D}, {0xA69E, 0xA69F}, {0xA6F0, 0xA6F1},
+    {0xA802, 0xA802}, {0xA806, 0xA806}, {0xA80B, 0xA80B}, {0xA825, 0xA826}, {0xA82C, 0xA82C},
+    {0xA8C4, 0xA8C5}, {0xA8E0, 0xA8F1}, {0xA8FF, 0xA8FF}, {0xA926, 0xA92D}, {0xA947, 0xA951},
+    {0xA980, 0xA982}, {0xA9B3, 0xA9B3}, {0xA9B6, 0xA9B9}, {0xA9BC, 0xA9BD}, {0xA9E5, 0xA9E5},
+    {0xAA29, 0xAA2E}, {0xAA31, 0xAA32}, {0xAA35, 0xAA36}, {0xAA43, 0xAA43}, {0xAA4C, 0xAA4C},
+    {0xAA7C, 0xAA7C}, {0xAAB0, 0xAAB0}, {0xAAB2, 0xAAB4}, {0xAAB7, 0xAAB8}, {0xAABE, 0xAABF},
+    {0xAAC1, 0xAAC1}, {0xAAEC, 0xAAED}, {0xAAF6, 0xAAF6}, {0xABE5, 0xABE5}, {0xABE8, 0xABE8},
+    {0xABED, 0xABED}, {0xD7B0, 0xD7FF}, {0xFB1E, 0xFB1E}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+    {0xFEFF, 0xFEFF}, {0xFFF9, 0xFFFB}, {0x101FD, 0x101FD}, {0x102E0, 0x102E0}, {0x10376, 0x1037A},
+    {0x10A01, 0x10A03}, {0x10A05, 0x10A06}, {0x10A0C, 0x10A0F}, {0x10A38, 0x10A3A},
+    {0x10A3F, 0x10A3F}, {0x10AE5, 0x10AE6}, {0x10D24, 0x10D27}, {0x10EAB, 0x10EAC},
+    {0x10F46, 0x10F50}, {0x10F82, 0x10F85}, {0x11001, 0x11001}, {0x11038, 0x11046},
+    {0x11070, 0x11070}, {0x11073, 0x11074}, {0x1107F, 0x11081}, {0x110B3, 0x110B6},
+    {0x110B9, 0x110BA}, {0x110C2, 0x110C2}, {0x11100, 0x11102}, {0x11127, 0x1112B},
+    {0x1112D, 0x11134}, {0x11173, 0x11173}, {0x11180, 0x11181}, {0x111B6, 0x111BE},
+    {0x111C9, 0x111CC}, {0x111CF, 0x111CF}, {0x1122F, 0x11231}, {0x11234, 0x11234},
+    {0x11236, 0x11237}, {0x1123E, 0x1123E}, {0x112DF, 0x112DF}, {0x112E3, 0x112EA},
+    {0x11300, 0x11301}, {0x1133B, 0x1133C}, {0x11340, 0x11340}, {0x11366, 0x1136C},
+    {0x11370, 0x11374}, {0x11438, 0x1143F}, {0x11442, 0x11444}, {0x11446, 0x11446},
+    {0x1145E, 0x1145E}, {0x114B3, 0x114B8}, {0x114BA, 0x114BA}, {0x114BF, 0x114C0},
+    {0x114C2, 0x114C3}, {0x115B2, 0x115B5}, {0x115BC, 0x115BD}, {0x115BF, 0x115C0},
+    {0x115DC, 0x115DD}, {0x11633, 0x1163A}, {0x1163D, 0x1163D}, {0x1163F, 0x11640},
+    {0x116AB, 0x116AB}, {0x116AD, 0x116AD}, {0x116B0, 0x116B5}, {0x116B7, 0x116B7},
+    {0x1171D, 0x1171F}, {0x11722, 0x11725}, {0x11727, 0x1172B}, {0x1182F, 0x11837},
+    {0x11839, 0x1183A}, {0x1193B, 0x1193C}, {0x1193E, 0x1193E}, {0x11943, 0x11943},
+    {0x119D4, 0x119D7}, {0x119DA, 0x119DB}, {0x119E0, 0x119E0}, {0x11A01, 0x11A0A},
+    {0x11A33, 0x11A38}, {0x11A3B, 0x11A3E}, {0x11A47, 0x11A47}, {0x11A51, 0x11A56},
+    {0x11A59, 0x11A5B}, {0x11A8A, 0x11A96}, {0x11A98, 0x11A99}, {0x11C30, 0x11C36},
+    {0x11C38, 0x11C3D}, {0x11C3F, 0x11C3F}, {0x11C92, 0x11CA7}, {0x11CAA, 0x11CB0},
+    {0x11CB2, 0x11CB3}, {0x11CB5, 0x11CB6}, {0x11D31, 0x11D36}, {0x11D3A, 0x11D3A},
+    {0x11D3C, 0x11D3D}, {0x11D3F, 0x11D45}, {0x11D47, 0x11D47}, {0x11D90, 0x11D91},
+    {0x11D95, 0x11D95}, {0x11D97, 0x11D97}, {0x11EF3, 0x11EF4}, {0x13430, 0x13438},
+    {0x16AF0, 0x16AF4}, {0x16B30, 0x16B36}, {0x16F4F, 0x16F4F}, {0x16F8F, 0x16F92},
+    {0x16FE4, 0x16FE4}, {0x1BC9D, 0x1BC9E}, {0x1BCA0, 0x1BCA3}, {0x1CF00, 0x1CF2D},
+    {0x1CF30, 0x1CF46}, {0x1D167, 0x1D169}, {0x1D173, 0x1D182}, {0x1D185, 0x1D18B},
+    {0x1D1AA, 0x1D1AD}, {0x1D242, 0x1D244}, {0x1DA00, 0x1DA36}, {0x1DA3B, 0x1DA6C},
+    {0x1DA75, 0x1DA75}, {0x1DA84, 0x1DA84}, {0x1DA9B, 0x1DA9F}, {0x1DAA1, 0x1DAAF},
+    {0x1E000, 0x1E006}, {0x1E008, 0x1E018}, {0x1E01B, 0x1E021}, {0x1E023, 0x1E024},
+    {0x1E026, 0x1E02A}, {0x1E130, 0x1E136}, {0x1E2AE, 0x1E2AE}, {0x1E2EC, 0x1E2EF},
+    {0x1E8D0, 0x1E8D6}, {0x1E944, 0x1E94A}, {0xE0001, 0xE0001}, {0xE0020, 0xE007F},
+    {0xE0100, 0xE01EF}
+};
+
+// ranges of double-width code points: East Asian Wide (W) and Fullwidth (F)
+// characters, including emoji with default emoji presentation, and
+// regional indicators
+static const int wideRanges[][2] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0},
+    {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F},
+    {0x2693, 0x2693}, {0x26A1, 0x26A1}, {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B}, {0x2728, 0x2728},
+    {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+    {0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55},
+    {0x2E80, 0x2E99}, {0x2E9B, 0x2EF3}, {0x2F00, 0x2FD5}, {0x2FF0, 0x2FFB}, {0x3000, 0x3029},
+    {0x302E, 0x303E}, {0x3041, 0x3096}, {0x309B, 0x30FF}, {0x3105, 0x312F}, {0x3131, 0x318E},
+    {0x3190, 0x31E3}, {0x31F0, 0x321E}, {0x3220, 0xA48C}, {0xA490, 0xA4C6}, {0xA960, 0xA97C},
+    {0xAC00, 0xD7A3}, {0xF900, 0xFA6D}, {0xFA70, 0xFAD9}, {0xFE10, 0xFE19}, {0xFE30, 0xFE52},
+    {0xFE54, 0xFE66}, {0xFE68, 0xFE6B}, {0xFF01, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE3},
+    {0x16FF0, 0x16FF1}, {0x17000, 0x187F7}, {0x18800, 0x18CD5}, {0x18D00, 0x18D08},
+    {0x1AFF0, 0x1AFF3}, {0x1AFF5, 0x1AFFB}, {0x1AFFD, 0x1AFFE}, {0x1B000, 0x1B122},
+    {0x1B150, 0x1B152}, {0x1B164, 0x1B167}, {0x1B170, 0x1B2FB}, {0x1F004, 0x1F004},
+    {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F1E6, 0x1F202},
+    {0x1F210, 0x1F23B}, {0x1F240, 0x1F248}, {0x1F250, 0x1F251}, {0x1F260, 0x1F265},
+    {0x1F300, 0x1F320}, {0x1F32D, 0x1F335}, {0x1F337, 0x1F37C}, {0x1F37E, 0x1F393},
+    {0x1F3A0, 0x1F3CA}, {0x1F3CF, 0x1F3D3}, {0x1F3E0, 0x1F3F0}, {0x1F3F4, 0x1F3F4},
+    {0x1F3F8, 0x1F43E}, {0x1F440, 0x1F440}, {0x1F442, 0x1F4FC}, {0x1F4FF, 0x1F53D},
+    {0x1F54B, 0x1F54E}, {0x1F550, 0x1F567}, {0x1F57A, 0x1F57A}, {0x1F595, 0x1F596},
+    {0x1F5A4, 0x1F5A4}, {0x1F5FB, 0x1F64F}, {0x1F680, 0x1F6C5}, {0x1F6CC, 0x1F6CC},
+    {0x1F6D0, 0x1F6D2}, {0x1F6D5, 0x1F6D7}, {0x1F6DD, 0x1F6DF}, {0x1F6EB, 0x1F6EC},
+    {0x1F6F4, 0x1F6FC}, {0x1F7E0, 0x1F7EB}, {0x1F7F0, 0x1F7F0}, {0x1F90C, 0x1F93A},
+    {0x1F93C, 0x1F945}, {0x1F947, 0x1F9FF}, {0x1FA70, 0x1FA74}, {0x1FA78, 0x1FA7C},
+    {0x1FA80, 0x1FA86}, {0x1FA90, 0x1FAAC}, {0x1FAB0, 0x1FABA}, {0x1FAC0, 0x1FAC5},
+    {0x1FAD0, 0x1FAD9}, {0x1FAE0, 0x1FAE7}, {0x1FAF0, 0x1FAF6}, {0x20000, 0x2FFFD},
+    {0x30000, 0x3FFFD}
+};
+// END generated width tables
+
+// helper function to check if a code point is in a sorted table of ranges
+int inRangeTable(const int ranges[][2], int count, int codePoint) {
+    // binary search for the range that could contain the code point
+    int low = 0;
+    int high = count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (codePoint < ranges[mid][0]) {
+            high = mid - 1;
+        }
+        else if (codePoint > ranges[mid][1]) {
+            low = mid + 1;
+        }
+        else {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    if (res == expected){
-        printf("PASSED: String 1=\"%s\", String 2=\"%s\", Expected=%d, Result=%d\n", str1, str2, expected, res);
+// Returns the number of terminal columns (0, 1 or 2) a code point takes up
+// on its own. Control characters take up 0 columns.
+int my_utf8_codepoint_width(int codePoint) {
+    if (codePoint >= 0x20 && codePoint < 0x7F) {
+        return 1; // printable ASCII
     }
-    else {
-        printf("FAILED: String 1=\"%s\", String 2=\"%s\", Expected=%d, Result=%d\n", str1, str2, expected, res);
+    if (codePoint < 0xA0) {
+        return 0; // C0 and C1 control characters
+    }
+    if (codePoint < 0x0300) {
+        return 1; // Latin-1 and Latin Extended have no zero-width or wide characters
+    }
+    if (inRangeTable(zeroWidthRanges, sizeof(zeroWidthRanges) / sizeof(zeroWidthRanges[0]), codePoint)) {
+        return 0;
+    }
+    if (inRangeTable(wideRanges, sizeof(wideRanges) / sizeof(wideRanges[0]), codePoint)) {
+        return 2;
     }
+    return 1;
 }
 
-void test_all_utf8_encode(){
-    printf("Testing my_utf8_encode:\n");
-    test_utf8_encode((unsigned char*)"", (unsigned char*)"");
-    test_utf8_encode((unsigned char*)"A", (unsigned char*)"A");
-    test_utf8_encode((unsigned char*)"Hello", (unsigned char*)"Hello");
-    test_utf8_encode((unsigned char*)"\\u1846", (unsigned char*)"ᡆ");
-    test_utf8_encode((unsigned char*)"\\u10D2\\u10D0\\u10DB\\u10D0\\u10E0\\u10EF\\u10DD\\u10D1\\u10D0",
-                     (unsigned char*)"გამარჯობა");
-    test_utf8_encode((unsigned char*)"\\u103a8", (unsigned char*)"𐎨");
+// helper function to measure the display width of the first len bytes of a
+// string, stopping before the first character that would go past maxColumns
+// (-1 for no limit). Stores the number of bytes measured in *bytes and returns
+// the number of columns, or -1 if the string is not valid UTF-8. Statistics
+// are counted for the entry point fn.
+int measureColumns(unsigned const char *str, int len, int maxColumns, int *bytes, int fn) {
+    int columns = 0;
+    int i = 0;
+    int bulk = 0;         // bytes counted 8 at a time
+    int baseWidth = 0;    // width of the last character that took up columns
+    int baseStart = 0;    // byte offset of that character
+    int baseColumns = 0;  // columns before that character
+    int joined = 0;       // 1 after a zero width joiner that follows an emoji
+    int regional = 0;     // 1 after a regional indicator that starts a flag
+
+    while (i < len) {
+        // count 8 printable ASCII characters at once
+        if (i + 8 <= len && (maxColumns < 0 || columns + 8 <= maxColumns)) {
+            uint64_t word;
+            memcpy(&word, str + i, 8);
+
+            uint64_t high = word & 0x8080808080808080ULL;
+            // bytes below 0x20 (control characters)
+            uint64_t control = (word - 0x2020202020202020ULL) & ~word & 0x8080808080808080ULL;
+            // bytes equal to 0x7F (DEL)
+            uint64_t del = word ^ 0x7F7F7F7F7F7F7F7FULL;
+            del = (del - 0x0101010101010101ULL) & ~del & 0x8080808080808080ULL;
+
+            if ((high | control | del) == 0) {
+                columns += 8;
+                bulk += 8;
+                baseWidth = 1;
+                baseStart = i + 7;
+                baseColumns = columns - 1;
+                joined = 0;
+                regional = 0;
+                i += 8;
+                continue;
+            }
+        }
+
+        int codePoint;
+        int numBytes;
+        if (getUTF8CharInfo(str, i, &codePoint, &numBytes) == -1 || i + numBytes > len) {
+            MY_UTF8_STAT_ADD(fn, errors, 1);
+            MY_UTF8_STAT_ADD(fn, bytes, i);
+            return -1; // invalid UTF-8
+        }
+
+        int width = my_utf8_codepoint_width(codePoint);
+        if (codePoint == 0xFE0F) {
+            // emoji presentation selector: a narrow base becomes 2 columns wide
+            width = (baseWidth == 1) ? 1 : 0;
+            if (width == 1 && maxColumns >= 0 && columns + 1 > maxColumns) {
+                // the wide emoji does not fit, so drop its base as well
+                MY_UTF8_STAT_ADD(fn, bytes, i);
+                MY_UTF8_STAT_ADD(fn, asciiBytes, bulk);
+                MY_UTF8_STAT_ADD(fn, multiByteBytes, i - bulk);
+                *bytes = baseStart;
+                return baseColumns;
+            }
+            if (width == 1) {
+                baseWidth = 2;
+            }
+        }
+        else if (codePoint == 0x200D) {
+            // zero width joiner: the next character is drawn as part of the emoji
+            joined = (baseWidth == 2);
+        }
+        else if (joined) {
+            width = 0;
+            joined = 0;
+        }
+        else if (codePoint >= 0x1F3FB && codePoint <= 0x1F3FF && baseWidth == 2) {
+            width = 0; // skin tone modifier applied to the emoji before it
+        }
+        else if (codePoint >= 0x1F1E6 && codePoint <= 0x1F1FF && regional) {
+            width = 0; // second regional indicator of a flag
+        }
+
+        if (maxColumns >= 0 && columns + width > maxColumns) {
+            break; // character does not fit
+        }
+
+        if (width > 0 && codePoint != 0xFE0F) {
+            baseWidth = width;
+            baseStart = i;
+            baseColumns = columns;
+        }
+        regional = (codePoint >= 0x1F1E6 && codePoint <= 0x1F1FF && width > 0);
+        columns += width;
+        i += numBytes;
+    }
+
+    MY_UTF8_STAT_ADD(fn, bytes, i);
+    MY_UTF8_STAT_ADD(fn, asciiBytes, bulk);
+    MY_UTF8_STAT_ADD(fn, multiByteBytes, i - bulk);
+    *bytes = i;
+    return columns;
+}
+
+// Returns the number of terminal columns a UTF-8 encoded string takes up,
+// or -1 if the string is not valid UTF-8
+int my_utf8_display_width(unsigned const char *str) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_DISPLAY_WIDTH, calls, 1);
+    if (str == NULL) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_DISPLAY_WIDTH, errors, 1);
+        return -1; // Invalid input
+    }
+
+    int bytes;
+    return measureColumns(str, (int)strlen((const char *)str), -1, &bytes,
+                          MY_UTF8_FN_DISPLAY_WIDTH);
+}
+
+// Returns the number of bytes to keep so that the string fits in maxColumns
+// terminal columns, without splitting a character from the marks and emoji
+// modifiers that follow it. Returns -1 on invalid input.
+int my_utf8_truncate_columns(unsigned const char *str, int maxColumns) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_TRUNCATE_COLUMNS, calls, 1);
+    if (str == NULL || maxColumns < 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_TRUNCATE_COLUMNS, errors, 1);
+        return -1; // Invalid input
+    }
+
+    int bytes;
+    if (measureColumns(str, (int)strlen((const char *)str), maxColumns, &bytes,
+                       MY_UTF8_FN_TRUNCATE_COLUMNS) < 0) {
+        return -1;
+    }
+    return bytes;
+}
+
+// helper function to make room for count lines (plus the end of text entry)
+// in a line index. Statistics are counted for the entry point fn.
+int lineIndexReserve(my_utf8_line_index *index, int count, int fn) {
+    if (count + 1 <= index->capacity) {
+        return 0; // already big enough
+    }
+
+    int capacity = (index->capacity > 0) ? index->capacity : 16;
+    while (capacity < count + 1) {
+        capacity *= 2;
+    }
+
+    MY_UTF8_STAT_ADD(fn, allocations, 4);
+    for (int k = 0; k < 3; ++k) {
+        int *grown = (int*)realloc(index->starts[k], capacity * sizeof(int));
+        if (grown == NULL) {
+            return -1;
+        }
+        index->starts[k] = grown;
+    }
+    unsigned char *ascii = (unsigned char*)realloc(index->ascii, capacity * sizeof(unsigned char));
+    if (ascii == NULL) {
+        return -1;
+    }
+    index->ascii = ascii;
+    index->capacity = capacity;
+    return 0;
+}
+
+// helper function to add a line starting at the given offsets to a line index
+int lineIndexPush(my_utf8_line_index *index, int bytePos, int charPos, int utf16Pos, int fn) {
+    if (lineIndexReserve(index, index->lineCount + 1, fn) != 0) {
+        return -1;
+    }
+    index->starts[MY_UTF8_OFFSET_BYTE][index->lineCount] = bytePos;
+    index->starts[MY_UTF8_OFFSET_CHAR][index->lineCount] = charPos;
+    index->starts[MY_UTF8_OFFSET_UTF16][index->lineCount] = utf16Pos;
+    index->ascii[index->lineCount] = 1;
+    index->lineCount++;
+    return 0;
+}
+
+// helper function to scan the bytes [from, to) of a text into an empty line
+// index. The first line starts at character charPos and UTF-16 unit utf16Pos.
+// Words of 8 bytes without a newline or a non-ASCII byte are skipped in bulk.
+// Statistics are counted for the entry point fn.
+int scanLines(my_utf8_line_index *index, unsigned const char *text, int from, int to,
+              int charPos, int utf16Pos, int fn) {
+    int bulk = 0; // bytes skipped 8 at a time
+
+    MY_UTF8_STAT_ADD(fn, bytes, to - from);
+    index->lineCount = 0;
+    if (lineIndexPush(index, from, charPos, utf16Pos, fn) != 0) {
+        return -1;
+    }
+
+    int i = from;
+    while (i < to) {
+        int end = to; // where the byte-at-a-time scan stops
+
+        if (i + 8 <= to) {
+            uint64_t word;
+            memcpy(&word, text + i, 8);
+
+            // a byte equal to '\n' becomes zero after the XOR, and the
+            // subtract trick sets bit 7 of the first zero byte
+            uint64_t nl = word ^ 0x0A0A0A0A0A0A0A0AULL;
+            uint64_t newline = (nl - 0x0101010101010101ULL) & ~nl & 0x8080808080808080ULL;
+
+            if (((word & 0x8080808080808080ULL) | newline) == 0) {
+                // 8 ASCII characters, no line break
+                charPos += 8;
+                utf16Pos += 8;
+                i += 8;
+                bulk += 8;
+                continue;
+            }
+            end = i + 8;
+        }
+
+        for (; i < end; ++i) {
+            unsigned char c = text[i];
+
+            if (c >= 0x80) { // part of a multi-byte character
+                index->ascii[index->lineCount - 1] = 0;
+                if ((c & 0xC0) != 0x80) { // first byte of the character
+                    charPos++;
+                    utf16Pos += (c >= 0xF0) ? 2 : 1; // 4-byte characters need a surrogate pair
+                }
+            }
+            else {
+                charPos++;
+                utf16Pos++;
+                if (c == '\n' && lineIndexPush(index, i + 1, charPos, utf16Pos, fn) != 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    MY_UTF8_STAT_ADD(fn, asciiBytes, bulk);
+    MY_UTF8_STAT_ADD(fn, multiByteBytes, (to - from) - bulk);
+
+    // record the end of the scanned text after the last line
+    index->starts[MY_UTF8_OFFSET_BYTE][index->lineCount] = to;
+    index->starts[MY_UTF8_OFFSET_CHAR][index->lineCount] = charPos;
+    index->starts[MY_UTF8_OFFSET_UTF16][index->lineCount] = utf16Pos;
+    return 0;
+}
+
+// Frees the memory held by a line index
+void my_utf8_line_index_free(my_utf8_line_index *index) {
+    if (index == NULL) {
+        return;
+    }
+    for (int k = 0; k < 3; ++k) {
+        free(index->starts[k]);
+    }
+    free(index->ascii);
+    memset(index, 0, sizeof(*index));
+}
+
+// Builds the line index of a text in a single pass. len is the length of the
+// text in bytes, or -1 if the text is null-terminated. Lines end with '\n'.
+// The text is not copied and must stay alive while the index is used.
+// Returns 0 on success and -1 on error.
+int my_utf8_line_index_build(my_utf8_line_index *index, unsigned const char *text, int len) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_LINE_INDEX_BUILD, calls, 1);
+    if (index == NULL || text == NULL) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_LINE_INDEX_BUILD, errors, 1);
+        return -1; // Invalid input
+    }
+    if (len < 0) {
+        len = (int)strlen((const char *)text);
+    }
+
+    memset(index, 0, sizeof(*index));
+    index->text = text;
+    index->length = len;
+
+    if (scanLines(index, text, 0, len, 0, 0, MY_UTF8_FN_LINE_INDEX_BUILD) != 0) {
+        my_utf8_line_index_free(index);
+        return -1;
+    }
+    return 0;
+}
+
+// Returns the line that contains the given offset (of the given kind), or -1
+// if the offset is out of bounds
+int my_utf8_line_of(const my_utf8_line_index *index, int offset, int kind) {
+    if (index == NULL || kind < MY_UTF8_OFFSET_BYTE || kind > MY_UTF8_OFFSET_UTF16 ||
+        offset < 0 || offset > index->starts[kind][index->lineCount]) {
+        return -1; // Invalid input
+    }
+
+    // binary search for the last line starting at or before offset
+    int low = 0;
+    int high = index->lineCount - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (index->starts[kind][mid] <= offset) {
+            low = mid;
+        }
+        else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+// Converts an offset of kind from into an offset of kind to (byte, code point
+// or UTF-16 offsets). An offset that falls inside a character is moved back
+// to the start of that character. Returns -1 if the offset is out of bounds.
+int my_utf8_offset_convert(const my_utf8_line_index *index, int offset, int from, int to) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_OFFSET_CONVERT, calls, 1);
+    int line = my_utf8_line_of(index, offset, from);
+    if (line < 0 || to < MY_UTF8_OFFSET_BYTE || to > MY_UTF8_OFFSET_UTF16) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_OFFSET_CONVERT, errors, 1);
+        return -1; // Invalid input
+    }
+
+    int target = offset - index->starts[from][line]; // offset inside the line
+    if (index->ascii[line]) {
+        // every kind of offset is the same on an ASCII line
+        return index->starts[to][line] + target;
+    }
+
+    // walk the line one character at a time until the target is reached
+    unsigned const char *text = index->text;
+    int pos = index->starts[MY_UTF8_OFFSET_BYTE][line];
+    int lineEnd = index->starts[MY_UTF8_OFFSET_BYTE][line + 1];
+    int units[3] = {0, 0, 0};
+
+    while (pos < lineEnd) {
+        int step[3];
+
+        // size of the character in bytes: its first byte plus continuation bytes
+        step[MY_UTF8_OFFSET_BYTE] = 1;
+        while (pos + step[MY_UTF8_OFFSET_BYTE] < lineEnd &&
+               (text[pos + step[MY_UTF8_OFFSET_BYTE]] & 0xC0) == 0x80) {
+            step[MY_UTF8_OFFSET_BYTE]++;
+        }
+        // stray continuation bytes do not count as characters
+        step[MY_UTF8_OFFSET_CHAR] = ((text[pos] & 0xC0) != 0x80);
+        step[MY_UTF8_OFFSET_UTF16] = step[MY_UTF8_OFFSET_CHAR] ? ((text[pos] >= 0xF0) ? 2 : 1) : 0;
+
+        if (units[from] + step[from] > target) {
+            break; // target is inside (or at the start of) this character
+        }
+        for (int k = 0; k < 3; ++k) {
+            units[k] += step[k];
+        }
+        pos += step[MY_UTF8_OFFSET_BYTE];
+    }
+
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_OFFSET_CONVERT, bytes, units[MY_UTF8_OFFSET_BYTE]);
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_OFFSET_CONVERT, multiByteBytes, units[MY_UTF8_OFFSET_BYTE]);
+    return index->starts[to][line] + units[to];
+}
+
+// Updates a line index after the bytes [editStart, oldEnd) of the old text
+// were replaced, giving newText in which the replacement covers the bytes
+// [editStart, newEnd). Only the lines touched by the edit are scanned again;
+// the lines after it are shifted. Returns 0 on success and -1 on error.
+int my_utf8_line_index_update(my_utf8_line_index *index, unsigned const char *newText, int newLen,
+                              int editStart, int oldEnd, int newEnd) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_LINE_INDEX_UPDATE, calls, 1);
+    if (index == NULL || newText == NULL || editStart < 0 || oldEnd < editStart ||
+        oldEnd > index->length || newEnd < editStart) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_LINE_INDEX_UPDATE, errors, 1);
+        return -1; // Invalid input
+    }
+    if (newLen < 0) {
+        newLen = (int)strlen((const char *)newText);
+    }
+    int byteDelta = newEnd - oldEnd;
+    if (newLen != index->length + byteDelta) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_LINE_INDEX_UPDATE, errors, 1);
+        return -1; // edit does not match the new text
+    }
+
+    int first = my_utf8_line_of(index, editStart, MY_UTF8_OFFSET_BYTE);
+    int last = my_utf8_line_of(index, oldEnd, MY_UTF8_OFFSET_BYTE);
+    int oldCount = index->lineCount;
+
+    // scan the edited lines again, in the new text
+    my_utf8_line_index region;
+    memset(&region, 0, sizeof(region));
+    if (scanLines(&region, newText, index->starts[MY_UTF8_OFFSET_BYTE][first],
+                  index->starts[MY_UTF8_OFFSET_BYTE][last + 1] + byteDelta,
+                  index->starts[MY_UTF8_OFFSET_CHAR][first],
+                  index->starts[MY_UTF8_OFFSET_UTF16][first], MY_UTF8_FN_LINE_INDEX_UPDATE) != 0) {
+        my_utf8_line_index_free(&region);
+        return -1;
+    }
+
+    // unless the edit reaches the last line, the scan ends with the start of
+    // the first line after the edit, which is kept from the old index
+    int added = region.lineCount - ((last == oldCount - 1) ? 0 : 1);
+    int newCount = first + added + (oldCount - last - 1);
+    if (lineIndexReserve(index, newCount, MY_UTF8_FN_LINE_INDEX_UPDATE) != 0) {
+        my_utf8_line_index_free(&region);
+        return -1;
+    }
+
+    // shift the lines after the edit (and the end of text entry) into place
+    int tail = oldCount - last;
+    for (int k = 0; k < 3; ++k) {
+        int delta = region.starts[k][region.lineCount] - index->starts[k][last + 1];
+
+        memmove(index->starts[k] + first + added, index->starts[k] + last + 1, tail * sizeof(int));
+        for (int j = first + added; j <= newCount; ++j) {
+            index->starts[k][j] += delta;
+        }
+        memcpy(index->starts[k] + first, region.starts[k], added * sizeof(int));
+    }
+    memmove(index->ascii + first + added, index->ascii + last + 1, tail * sizeof(unsigned char));
+    memcpy(index->ascii + first, region.ascii, added * sizeof(unsigned char));
+
+    index->lineCount = newCount;
+    index->text = newText;
+    index->length = newLen;
+
+    my_utf8_line_index_free(&region);
+    return 0;
+}
+
+// a node of a rope: one chunk of the text, in an implicit treap (a binary
+// tree kept balanced by random priorities) ordered by position in the text
+struct my_utf8_rope_node {
+    my_utf8_rope_node *left;
+    my_utf8_rope_node *right;
+    unsigned int priority;      // a node's priority is above its children's
+    unsigned char *text;        // chunk of at most MY_UTF8_ROPE_CHUNK bytes
+    int capacity;               // bytes allocated for text
+    int size[4];                // bytes, characters, UTF-16 units and newlines in the chunk
+    int total[4];               // the same for the whole subtree
+};
+
+// helper function to count the bytes, characters, UTF-16 units and newlines
+// in the first len bytes of a chunk, looking at 8 bytes at a time
+void ropeMeasure(unsigned const char *str, int len, int *size) {
+    int newlines = 0;
+    int fourByte = 0; // 4-byte characters take two UTF-16 units
+    int i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, str + i, 8);
+
+        // a byte equal to '\n' becomes zero after the XOR; adding 0x7F to the
+        // low 7 bits sets bit 7 of every byte that is not zero, without carries
+        uint64_t nl = word ^ 0x0A0A0A0A0A0A0A0AULL;
+        uint64_t zero = ~(((nl & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | nl) &
+                        0x8080808080808080ULL;
+        newlines += (int)(((zero >> 7) * 0x0101010101010101ULL) >> 56);
+
+        // a 4-byte first byte (11110xxx) has bits 7 to 4 set
+        uint64_t lead = word & (word << 1) & (word << 2) & (word << 3) & 0x8080808080808080ULL;
+        fourByte += (int)(((lead >> 7) * 0x0101010101010101ULL) >> 56);
+    }
+    for (; i < len; ++i) {
+        newlines += (str[i] == '\n');
+        fourByte += (str[i] >= 0xF0);
+    }
+
+    size[MY_UTF8_OFFSET_BYTE] = len;
+    size[MY_UTF8_OFFSET_CHAR] = len - countContinuationBytes(str, len);
+    size[MY_UTF8_OFFSET_UTF16] = size[MY_UTF8_OFFSET_CHAR] + fourByte;
+    size[MY_UTF8_ROPE_NEWLINES] = newlines;
+}
+
+// helper function to recompute the subtree counts of a node from its children
+void ropeUpdate(my_utf8_rope_node *node) {
+    for (int k = 0; k < 4; ++k) {
+        node->total[k] = node->size[k];
+        if (node->left != NULL) {
+            node->total[k] += node->left->total[k];
+        }
+        if (node->right != NULL) {
+            node->total[k] += node->right->total[k];
+        }
+    }
+}
+
+// helper function to make a node holding a copy of len bytes of text
+my_utf8_rope_node *ropeNewNode(my_utf8_rope *rope, unsigned const char *text, int len, int fn) {
+    my_utf8_rope_node *node = (my_utf8_rope_node*)malloc(sizeof(my_utf8_rope_node));
+    unsigned char *copy = (unsigned char*)malloc((len > 0) ? len : 1);
+    MY_UTF8_STAT_ADD(fn, allocations, 2);
+    if (node == NULL || copy == NULL) {
+        free(node);
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy, text, len);
+
+    // xorshift random numbers keep the tree balanced whatever the edits are
+    rope->seed ^= rope->seed << 13;
+    rope->seed ^= rope->seed >> 17;
+    rope->seed ^= rope->seed << 5;
+
+    node->left = NULL;
+    node->right = NULL;
+    node->priority = rope->seed;
+    node->text = copy;
+    node->capacity = (len > 0) ? len : 1;
+    ropeMeasure(copy, len, node->size);
+    ropeUpdate(node);
+    return node;
+}
+
+// helper function to free a subtree
+void ropeFree(my_utf8_rope_node *node) {
+    while (node != NULL) {
+        my_utf8_rope_node *right = node->right;
+        ropeFree(node->left);
+        free(node->text);
+        free(node);
+        node = right;
+    }
+}
+
+// helper function to join two trees, all of left coming before all of right
+my_utf8_rope_node *ropeMerge(my_utf8_rope_node *left, my_utf8_rope_node *right) {
+    if (left == NULL) {
+        return right;
+    }
+    if (right == NULL) {
+        return left;
+    }
+    if (left->priority > right->priority) {
+        left->right = ropeMerge(left->right, right);
+        ropeUpdate(left);
+        return left;
+    }
+    right->left = ropeMerge(left, right->left);
+    ropeUpdate(right);
+    return right;
+}
+
+// helper function to split a tree into its first charIndex characters (*left)
+// and the rest (*right). A chunk that holds the split is cut in two at the
+// character boundary. Returns -1 if out of memory, leaving the tree as it was.
+int ropeSplit(my_utf8_rope *rope, my_utf8_rope_node *node, int charIndex,
+              my_utf8_rope_node **left, my_utf8_rope_node **right, int fn) {
+    if (node == NULL) {
+        *left = NULL;
+        *right = NULL;
+        return 0;
+    }
+
+    int leftChars = (node->left != NULL) ? node->left->total[MY_UTF8_OFFSET_CHAR] : 0;
+    int chars = node->size[MY_UTF8_OFFSET_CHAR];
+
+    if (charIndex <= leftChars) { // split is in the left subtree
+        my_utf8_rope_node *r;
+        if (ropeSplit(rope, node->left, charIndex, left, &r, fn) != 0) {
+            return -1;
+        }
+        node->left = r;
+        ropeUpdate(node);
+        *right = node;
+        return 0;
+    }
+    if (charIndex >= leftChars + chars) { // split is in the right subtree
+        my_utf8_rope_node *l;
+        if (ropeSplit(rope, node->right, charIndex - leftChars - chars, &l, right, fn) != 0) {
+            return -1;
+        }
+        node->right = l;
+        ropeUpdate(node);
+        *left = node;
+        return 0;
+    }
+
+    // split is inside this chunk: move the end of the chunk into a new node.
+    // The tail takes the priority of the node it came from, so the subtree
+    // handed back to the caller fits under the node's ancestors.
+    int cut = utf8ByteOffset(node->text, node->size[MY_UTF8_OFFSET_BYTE], charIndex - leftChars);
+    my_utf8_rope_node *tail = ropeNewNode(rope, node->text + cut, node->size[MY_UTF8_OFFSET_BYTE] - cut, fn);
+    if (tail == NULL) {
+        return -1;
+    }
+    tail->priority = node->priority;
+    ropeMeasure(node->text, cut, node->size);
+    *right = ropeMerge(tail, node->right);
+    node->right = NULL;
+    ropeUpdate(node);
+    *left = node;
+    return 0;
+}
+
+// helper function to append len bytes (with counts size) to the last chunk of
+// a tree, updating the subtree counts on the way. Returns -1 if out of memory.
+int ropeAppendLast(my_utf8_rope_node *node, unsigned const char *text, int len, const int *size, int fn) {
+    if (node->right != NULL) {
+        if (ropeAppendLast(node->right, text, len, size, fn) != 0) {
+            return -1;
+        }
+    }
+    else {
+        int bytes = node->size[MY_UTF8_OFFSET_BYTE];
+        if (bytes + len > node->capacity) {
+            unsigned char *grown = (unsigned char*)realloc(node->text, bytes + len);
+            MY_UTF8_STAT_ADD(fn, allocations, 1);
+            if (grown == NULL) {
+                return -1;
+            }
+            node->text = grown;
+            node->capacity = bytes + len;
+        }
+        memcpy(node->text + bytes, text, len);
+        for (int k = 0; k < 4; ++k) {
+            node->size[k] += size[k];
+        }
+    }
+    for (int k = 0; k < 4; ++k) {
+        node->total[k] += size[k];
+    }
+    return 0;
+}
+
+// helper function to remove the first node of a tree (which has no left child)
+my_utf8_rope_node *ropeRemoveFirst(my_utf8_rope_node *node) {
+    if (node->left == NULL) {
+        my_utf8_rope_node *right = node->right;
+        free(node->text);
+        free(node);
+        return right;
+    }
+    node->left = ropeRemoveFirst(node->left);
+    ropeUpdate(node);
+    return node;
+}
+
+// helper function to join two trees like ropeMerge, but when the chunks that
+// meet at the join fit in one chunk they are combined, so that many small
+// edits do not leave many tiny chunks behind
+my_utf8_rope_node *ropeJoin(my_utf8_rope_node *left, my_utf8_rope_node *right, int fn) {
+    if (left != NULL && right != NULL) {
+        my_utf8_rope_node *last = left;
+        my_utf8_rope_node *first = right;
+        while (last->right != NULL) {
+            last = last->right;
+        }
+        while (first->left != NULL) {
+            first = first->left;
+        }
+        if (last->size[MY_UTF8_OFFSET_BYTE] + first->size[MY_UTF8_OFFSET_BYTE] <= MY_UTF8_ROPE_CHUNK &&
+            ropeAppendLast(left, first->text, first->size[MY_UTF8_OFFSET_BYTE], first->size, fn) == 0) {
+            right = ropeRemoveFirst(right);
+        }
+    }
+    return ropeMerge(left, right);
+}
+
+// helper function to build a tree of the chunks of a valid UTF-8 text, cutting
+// it on character boundaries. Returns 0 on success and -1 if out of memory.
+int ropeBuild(my_utf8_rope *rope, unsigned const char *text, int len, my_utf8_rope_node **tree, int fn) {
+    *tree = NULL;
+    int pos = 0;
+    while (pos < len) {
+        int end = pos + MY_UTF8_ROPE_CHUNK;
+        if (end >= len) {
+            end = len;
+        }
+        else {
+            while ((text[end] & 0xC0) == 0x80) {
+                end--; // do not cut a character in half
+            }
+        }
+
+        my_utf8_rope_node *node = ropeNewNode(rope, text + pos, end - pos, fn);
+        if (node == NULL) {
+            ropeFree(*tree);
+            *tree = NULL;
+            return -1;
+        }
+        *tree = ropeMerge(*tree, node);
+        pos = end;
+    }
+    return 0;
+}
+
+// helper function to insert len bytes (with counts size) into the chunk that
+// holds charIndex, if they fit in it. Returns 0 if inserted, 1 if the chunk
+// is full (or the tree is empty) and -1 if out of memory.
+int ropeInsertInChunk(my_utf8_rope_node *node, int charIndex, unsigned const char *text, int len,
+                      const int *size, int fn) {
+    if (node == NULL) {
+        return 1;
+    }
+
+    int leftChars = (node->left != NULL) ? node->left->total[MY_UTF8_OFFSET_CHAR] : 0;
+    int chars = node->size[MY_UTF8_OFFSET_CHAR];
+    int res;
+
+    if (charIndex < leftChars) {
+        res = ropeInsertInChunk(node->left, charIndex, text, len, size, fn);
+    }
+    else if (charIndex > leftChars + chars) {
+        res = ropeInsertInChunk(node->right, charIndex - leftChars - chars, text, len, size, fn);
+    }
+    else {
+        int bytes = node->size[MY_UTF8_OFFSET_BYTE];
+        if (bytes + len > MY_UTF8_ROPE_CHUNK) {
+            return 1;
+        }
+        if (bytes + len > node->capacity) {
+            // grow by doubling so typing into a chunk does not reallocate every time
+            int capacity = node->capacity * 2;
+            if (capacity < bytes + len) {
+                capacity = bytes + len;
+            }
+            if (capacity > MY_UTF8_ROPE_CHUNK) {
+                capacity = MY_UTF8_ROPE_CHUNK;
+            }
+            unsigned char *grown = (unsigned char*)realloc(node->text, capacity);
+            MY_UTF8_STAT_ADD(fn, allocations, 1);
+            if (grown == NULL) {
+                return -1;
+            }
+            node->text = grown;
+            node->capacity = capacity;
+        }
+
+        int at = utf8ByteOffset(node->text, bytes, charIndex - leftChars);
+        memmove(node->text + at + len, node->text + at, bytes - at);
+        memcpy(node->text + at, text, len);
+        for (int k = 0; k < 4; ++k) {
+            node->size[k] += size[k];
+        }
+        res = 0;
+    }
+
+    if (res == 0) {
+        for (int k = 0; k < 4; ++k) {
+            node->total[k] += size[k];
+        }
+    }
+    return res;
+}
+
+// helper function to copy the bytes [from, to) of a subtree to output
+void ropeCopyBytes(const my_utf8_rope_node *node, int from, int to, unsigned char *output) {
+    while (node != NULL && from < to) {
+        int leftBytes = (node->left != NULL) ? node->left->total[MY_UTF8_OFFSET_BYTE] : 0;
+        int bytes = node->size[MY_UTF8_OFFSET_BYTE];
+
+        if (from < leftBytes) {
+            int end = (to < leftBytes) ? to : leftBytes;
+            ropeCopyBytes(node->left, from, end, output);
+            output += end - from;
+            from = end;
+        }
+        if (from < to && from < leftBytes + bytes) {
+            int start = from - leftBytes;
+            int end = ((to < leftBytes + bytes) ? to : leftBytes + bytes) - leftBytes;
+            memcpy(output, node->text + start, end - start);
+            output += end - start;
+            from += end - start;
+        }
+
+        // continue in the right subtree
+        from -= leftBytes + bytes;
+        to -= leftBytes + bytes;
+        node = node->right;
+    }
+}
+
+// helper function to find the byte offset in a chunk of an offset of the
+// given kind. An offset inside a character is moved back to its start.
+int ropeChunkByte(unsigned const char *text, int len, int offset, int kind) {
+    if (kind == MY_UTF8_OFFSET_CHAR) {
+        return utf8ByteOffset(text, len, offset);
+    }
+
+    int pos = 0;
+    int units = 0; // offset of kind at pos
+    while (pos < len) {
+        int bytes = 1;
+        while (pos + bytes < len && (text[pos + bytes] & 0xC0) == 0x80) {
+            bytes++;
+        }
+        int step = (kind == MY_UTF8_OFFSET_BYTE) ? bytes : (text[pos] >= 0xF0) ? 2 : 1;
+        if (units + step > offset) {
+            break; // offset is at or inside this character
+        }
+        units += step;
+        pos += bytes;
+    }
+    return pos;
+}
+
+// Makes a rope holding a copy of a UTF-8 text. len is the length of the text
+// in bytes, or -1 if the text is null-terminated. Returns 0 on success and -1
+// if the text is not valid UTF-8 or memory runs out.
+int my_utf8_rope_init(my_utf8_rope *rope, unsigned const char *text, int len) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_INIT, calls, 1);
+    if (rope == NULL) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_INIT, errors, 1);
+        return -1; // Invalid input
+    }
+    rope->root = NULL;
+    rope->seed = 2463534242u;
+    if (text == NULL) {
+        return 0; // empty rope
+    }
+    if (len < 0) {
+        len = (int)strlen((const char *)text);
+    }
+
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_INIT, bytes, len);
+    if (my_utf8_check_bytes(text, len) != len ||
+        ropeBuild(rope, text, len, &rope->root, MY_UTF8_FN_ROPE_INIT) != 0) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_INIT, errors, 1);
+        return -1;
+    }
+    return 0;
+}
+
+// Frees the memory held by a rope
+void my_utf8_rope_free(my_utf8_rope *rope) {
+    if (rope == NULL) {
+        return;
+    }
+    ropeFree(rope->root);
+    rope->root = NULL;
+}
+
+// Returns the length of the text in a rope as a count of the given kind
+// (MY_UTF8_OFFSET_* or MY_UTF8_ROPE_NEWLINES), or -1 on invalid input
+int my_utf8_rope_length(const my_utf8_rope *rope, int kind) {
+    if (rope == NULL || kind < MY_UTF8_OFFSET_BYTE || kind > MY_UTF8_ROPE_NEWLINES) {
+        return -1; // Invalid input
+    }
+    return (rope->root != NULL) ? rope->root->total[kind] : 0;
+}
+
+// Inserts a UTF-8 text before the character at charIndex (charIndex can be the
+// length of the rope to append). len is the length of the text in bytes, or -1
+// if it is null-terminated. Takes O(log n) time plus the length of the text.
+// Returns 0 on success and -1 on invalid input or if memory runs out.
+int my_utf8_rope_insert(my_utf8_rope *rope, int charIndex, unsigned const char *text, int len) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_INSERT, calls, 1);
+    if (rope == NULL || text == NULL || charIndex < 0 ||
+        charIndex > my_utf8_rope_length(rope, MY_UTF8_OFFSET_CHAR)) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_INSERT, errors, 1);
+        return -1; // Invalid input
+    }
+    if (len < 0) {
+        len = (int)strlen((const char *)text);
+    }
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_INSERT, bytes, len);
+    if (my_utf8_check_bytes(text, len) != len) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_INSERT, errors, 1);
+        return -1; // not valid UTF-8
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    // a short insert usually fits into the chunk where it goes
+    if (len <= MY_UTF8_ROPE_CHUNK) {
+        int size[4];
+        ropeMeasure(text, len, size);
+        int res = ropeInsertInChunk(rope->root, charIndex, text, len, size, MY_UTF8_FN_ROPE_INSERT);
+        if (res <= 0) {
+            return res;
+        }
+    }
+
+    // otherwise split the tree at charIndex and put new chunks in between
+    my_utf8_rope_node *middle;
+    my_utf8_rope_node *left;
+    my_utf8_rope_node *right;
+    if (ropeBuild(rope, text, len, &middle, MY_UTF8_FN_ROPE_INSERT) != 0) {
+        return -1;
+    }
+    if (ropeSplit(rope, rope->root, charIndex, &left, &right, MY_UTF8_FN_ROPE_INSERT) != 0) {
+        ropeFree(middle);
+        return -1;
+    }
+    rope->root = ropeJoin(ropeJoin(left, middle, MY_UTF8_FN_ROPE_INSERT), right, MY_UTF8_FN_ROPE_INSERT);
+    return 0;
+}
+
+// Deletes charCount characters starting at charIndex (fewer if the rope ends
+// first) in O(log n) time. Returns 0 on success and -1 on invalid input or if
+// memory runs out.
+int my_utf8_rope_delete(my_utf8_rope *rope, int charIndex, int charCount) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_DELETE, calls, 1);
+    if (rope == NULL || charIndex < 0 || charCount < 0 ||
+        charIndex > my_utf8_rope_length(rope, MY_UTF8_OFFSET_CHAR)) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_DELETE, errors, 1);
+        return -1; // Invalid input
+    }
+
+    my_utf8_rope_node *left;
+    my_utf8_rope_node *rest;
+    my_utf8_rope_node *middle;
+    my_utf8_rope_node *right;
+    if (ropeSplit(rope, rope->root, charIndex, &left, &rest, MY_UTF8_FN_ROPE_DELETE) != 0) {
+        return -1;
+    }
+    if (ropeSplit(rope, rest, charCount, &middle, &right, MY_UTF8_FN_ROPE_DELETE) != 0) {
+        rope->root = ropeMerge(left, rest);
+        return -1;
+    }
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_DELETE, bytes, (middle != NULL) ? middle->total[MY_UTF8_OFFSET_BYTE] : 0);
+    ropeFree(middle);
+    rope->root = ropeJoin(left, right, MY_UTF8_FN_ROPE_DELETE);
+    return 0;
+}
+
+// Copies charCount characters starting at charIndex (fewer if the rope ends
+// first) into output as a null-terminated string. outputSize is the size of
+// output in bytes. Returns the number of bytes copied (without the null
+// byte), or -1 on invalid input or if output is too small.
+int my_utf8_rope_slice(const my_utf8_rope *rope, int charIndex, int charCount,
+                       unsigned char *output, int outputSize) {
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_SLICE, calls, 1);
+    int length = my_utf8_rope_length(rope, MY_UTF8_OFFSET_CHAR);
+    if (output == NULL || charIndex < 0 || charCount < 0 || charIndex > length) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_SLICE, errors, 1);
+        return -1; // Invalid input
+    }
+    if (charCount > length - charIndex) {
+        charCount = length - charIndex;
+    }
+
+    int from = my_utf8_rope_offset_convert(rope, charIndex, MY_UTF8_OFFSET_CHAR, MY_UTF8_OFFSET_BYTE);
+    int to = my_utf8_rope_offset_convert(rope, charIndex + charCount, MY_UTF8_OFFSET_CHAR, MY_UTF8_OFFSET_BYTE);
+    if (to - from + 1 > outputSize) {
+        MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_SLICE, errors, 1);
+        return -1; // output too small
+    }
+
+    MY_UTF8_STAT_ADD(MY_UTF8_FN_ROPE_SLICE, bytes, to - from);
+    ropeCopyBytes(rope->root, from, to, output);
+    output[to - from] = '\0';
+    return to - from;
+}
+
+// Converts an offset of kind from into an offset of kind to (byte, code point
+// or UTF-16 offsets) in O(log n) time using the counts kept in the tree. An
+// offset inside a character is moved back to its start. Returns -1 if the
+// offset is out of bounds.
+int my_utf8_rope_offset_convert(const my_utf8_rope *rope, int offset, int from, int to) {
+    if (from < MY_UTF8_OFFSET_BYTE || from > MY_UTF8_OFFSET_UTF16 ||
+        to < MY_UTF8_OFFSET_BYTE || to > MY_UTF8_OFFSET_UTF16 ||
+        offset < 0 || offset > my_utf8_rope_length(rope, from)) {
+        return -1; // Invalid input
+    }
+
+    const my_utf8_rope_node *node = rope->root;
+    int result = 0;
+    while (node != NULL) {
+        if (node->left != NULL && offset < node->left->total[from]) {
+            node = node->left;
+            continue;
+        }
+        if (node->left != NULL) {
+            offset -= node->left->total[from];
+            result += node->left->total[to];
+        }
+        if (offset < node->size[from]) {
+            // the offset is in this chunk: count the chunk up to it
+            int prefix[4];
+            int byte = ropeChunkByte(node->text, node->size[MY_UTF8_OFFSET_BYTE], offset, from);
+            ropeMeasure(node->text, byte, prefix);
+            return result + prefix[to];
+        }
+        offset -= node->size[from];
+        result += node->size[to];
+        node = node->right;
+    }
+    return result; // end of the text
+}
+
+// Returns the line that contains the given offset (of a MY_UTF8_OFFSET_* kind)
+// in O(log n) time, or -1 if the offset is out of bounds. Lines end with '\n'.
+int my_utf8_rope_line_of(const my_utf8_rope *rope, int offset, int kind) {
+    if (kind < MY_UTF8_OFFSET_BYTE || kind > MY_UTF8_OFFSET_UTF16 ||
+        offset < 0 || offset > my_utf8_rope_length(rope, kind)) {
+        return -1; // Invalid input
+    }
+
+    const my_utf8_rope_node *node = rope->root;
+    int line = 0;
+    while (node != NULL) {
+        if (node->left != NULL && offset < node->left->total[kind]) {
+            node = node->left;
+            continue;
+        }
+        if (node->left != NULL) {
+            offset -= node->left->total[kind];
+            line += node->left->total[MY_UTF8_ROPE_NEWLINES];
+        }
+        if (offset < node->size[kind]) {
+            int prefix[4];
+            int byte = ropeChunkByte(node->text, node->size[MY_UTF8_OFFSET_BYTE], offset, kind);
+            ropeMeasure(node->text, byte, prefix);
+            return line + prefix[MY_UTF8_ROPE_NEWLINES];
+        }
+        offset -= node->size[kind];
+        line += node->size[MY_UTF8_ROPE_NEWLINES];
+        node = node->right;
+    }
+    return line;
+}
+
+// Returns the offset (of a MY_UTF8_OFFSET_* kind) where a line starts in
+// O(log n) time, or -1 if there is no such line
+int my_utf8_rope_line_start(const my_utf8_rope *rope, int line, int kind) {
+    if (kind < MY_UTF8_OFFSET_BYTE || kind > MY_UTF8_OFFSET_UTF16 ||
+        line < 0 || line > my_utf8_rope_length(rope, MY_UTF8_ROPE_NEWLINES)) {
+        return -1; // Invalid input
+    }
+
+    // the line starts right after newline number line (counting from 1)
+    const my_utf8_rope_node *node = rope->root;
+    int result = 0;
+    while (node != NULL && line > 0) {
+        if (node->left != NULL && line <= node->left->total[MY_UTF8_ROPE_NEWLINES]) {
+            node = node->left;
+            continue;
+        }
+        if (node->left != NULL) {
+            line -= node->left->total[MY_UTF8_ROPE_NEWLINES];
+            result += node->left->total[kind];
+        }
+        if (line <= node->size[MY_UTF8_ROPE_NEWLINES]) {
+            // find the newline in this chunk and count the chunk up to it
+            const unsigned char *p = node->text;
+            while (line > 0) {
+                p = (const unsigned char *)memchr(p, '\n', node->text + node->size[MY_UTF8_OFFSET_BYTE] - p) + 1;
+                line--;
+            }
+            int prefix[4];
+            ropeMeasure(node->text, (int)(p - node->text), prefix);
+            return result + prefix[kind];
+        }
+        line -= node->size[MY_UTF8_ROPE_NEWLINES];
+        result += node->size[kind];
+        node = node->right;
+    }
+    return result;
+}
+
+// TESTING (left out when the file is built as a library with -DMY_UTF8_NO_TESTS)
+#ifndef MY_UTF8_NO_TESTS
+
+// TESTING - helper functions
+// manually compare two strings
+int compare_strings(unsigned char *str1, unsigned char *str2){
+    while (*str1 && *str2 && *str1 == *str2){
+        str1++;
+        str2++;
+    }
+
+    return (*str1 == '\0' && *str2 == '\0');
+}
+
+// TESTING
+void test_utf8_encode(unsigned char *input, unsigned char *expected){
+    unsigned char output[100];
+
+    int res = my_utf8_encode(input, output);
+
+    if (res == 0 && compare_strings(output, expected)){
+        printf("PASSED: Input=\"%s\", Expected=\"%s\", Output=\"%s\"\n", input, expected, output);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", Expected=\"%s\", Output=\"%s\"\n", input, expected, output);
+
+    }
+}
+
+void test_utf8_decode(unsigned char *input, unsigned char *expected) {
+    unsigned char output[100];
+
+    int res = my_utf8_decode(input, output);
+
+    if (res == 0 && compare_strings(output, expected)) {
+        printf("PASSED: Input=\"%s\", Expected=\"%s\", Output=\"%s\"\n", input, expected, output);
+    } 
+    else {
+        printf("FAILED: Input=\"%s\", Expected=\"%s\", Output=\"%s\"\n", input, expected, output);
+    }
+}
+
+void test_utf8_check(unsigned char *input, int expected){
+    int res = my_utf8_check(input);
+
+    if (res == expected){
+        printf("PASSED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+    } 
+    else {
+        printf("FAILED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+    }
+}
+
+void test_utf8_strlen(unsigned char *input, int expected){
+    int res = my_utf8_strlen(input);
+
+    if (res == expected){
+        printf("PASSED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+    }
+}
+
+void test_utf8_charat(unsigned char *input, int index, unsigned char *expected){
+    unsigned char *res = my_utf8_charat(input, index);
+
+    if (res != NULL){
+        printf("PASSED: Input=\"%s\", Index=%d, Expected=%s, Result=%s\n", input, index, expected, res);
+    }
+    else {
+        if (expected == NULL){
+            printf("PASSED: Input=\"%s\", Index=%d, Expected=NULL, Result=NULL\n", input, index);
+        }
+        else {
+            printf("FAILED: Input=\"%s\", Index=%d, Expected=%s, Result=%s\n", input, index, expected, res);
+        }
+    }
+}
+
+void test_utf8_strcmp(unsigned char *string1, unsigned char *string2, int expected){
+    int res = my_utf8_strcmp(string1, string2);
+
+    int sign = (res > 0) - (res < 0); // determine sign of result
+
+    if (sign == expected){
+        printf("PASSED: String 1=\"%s\", String 2=\"%s\", Expected=%d, Result=%d\n", string1, string2, expected, sign);
+    }
+    else {
+        printf("FAILED: String 1=\"%s\", String 2=\"%s\", Expected=%d, Result=%d\n", string1, string2, expected, sign);
+    }
+}
+
+void test_utf8_remove_whitespace(const unsigned char *input, unsigned char *expected) {
+    unsigned char *result = my_utf8_remove_whitespace(input);
+
+    if (result == NULL) {
+        printf("FAILED: Input=\"%s\", Expected=\"%s\", Result=NULL\n", input, expected);
+        return;
+    }
+
+    if (compare_strings(result, expected) == 1) {
+        printf("PASSED: Input=\"%s\", Expected=\"%s\", Result=\"%s\"\n", input, expected, result);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", Expected=\"%s\", Result=\"%s\"\n", input, expected, result);
+    }
+
+    free(result);
+}
+
+void test_utf8_anagram_checker(unsigned char* str1, unsigned char* str2, int expected){
+    int res = my_utf8_anagram_checker(str1, str2);
+
+    if (res == expected){
+        printf("PASSED: String 1=\"%s\", String 2=\"%s\", Expected=%d, Result=%d\n", str1, str2, expected, res);
+    }
+    else {
+        printf("FAILED: String 1=\"%s\", String 2=\"%s\", Expected=%d, Result=%d\n", str1, str2, expected, res);
+    }
+}
+
+void test_utf8_substr(unsigned char *input, int charStart, int charCount, unsigned char *expected) {
+    my_utf8_view res = my_utf8_substr(input, -1, charStart, charCount);
+
+    if (res.data == NULL) {
+        if (expected == NULL) {
+            printf("PASSED: Input=\"%s\", Start=%d, Count=%d, Expected=NULL, Result=NULL\n",
+                   input, charStart, charCount);
+        }
+        else {
+            printf("FAILED: Input=\"%s\", Start=%d, Count=%d, Expected=\"%s\", Result=NULL\n",
+                   input, charStart, charCount, expected);
+        }
+        return;
+    }
+
+    if (expected != NULL && (int)strlen((char *)expected) == res.bytes &&
+        memcmp(res.data, expected, res.bytes) == 0) {
+        printf("PASSED: Input=\"%s\", Start=%d, Count=%d, Expected=\"%s\", Result=\"%.*s\"\n",
+               input, charStart, charCount, expected, res.bytes, res.data);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", Start=%d, Count=%d, Expected=\"%s\", Result=\"%.*s\"\n",
+               input, charStart, charCount, expected, res.bytes, res.data);
+    }
+}
+
+void test_utf8_truncate_bytes(unsigned char *input, int maxBytes, int expected) {
+    int res = my_utf8_truncate_bytes(input, maxBytes);
+
+    if (res == expected) {
+        printf("PASSED: Input=\"%s\", MaxBytes=%d, Expected=%d, Result=%d\n", input, maxBytes, expected, res);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", MaxBytes=%d, Expected=%d, Result=%d\n", input, maxBytes, expected, res);
+    }
+}
+
+void test_utf8_display_width(unsigned char *input, int expected) {
+    int res = my_utf8_display_width(input);
+
+    if (res == expected) {
+        printf("PASSED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", Expected=%d, Result=%d\n", input, expected, res);
+    }
+}
+
+void test_utf8_truncate_columns(unsigned char *input, int maxColumns, int expected) {
+    int res = my_utf8_truncate_columns(input, maxColumns);
+
+    if (res == expected) {
+        printf("PASSED: Input=\"%s\", MaxColumns=%d, Expected=%d, Result=%d\n", input, maxColumns, expected, res);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", MaxColumns=%d, Expected=%d, Result=%d\n", input, maxColumns, expected, res);
+    }
+}
+
+void test_utf8_offset_convert(my_utf8_line_index *index, int offset, int from, int to, int expected) {
+    int res = my_utf8_offset_convert(index, offset, from, to);
+
+    if (res == expected) {
+        printf("PASSED: Offset=%d, From=%d, To=%d, Expected=%d, Result=%d\n", offset, from, to, expected, res);
+    }
+    else {
+        printf("FAILED: Offset=%d, From=%d, To=%d, Expected=%d, Result=%d\n", offset, from, to, expected, res);
+    }
+}
+
+// apply an edit to an index of oldText and compare it with a fresh index of newText
+void test_utf8_line_index_update(unsigned char *oldText, unsigned char *newText,
+                                 int editStart, int oldEnd, int newEnd) {
+    my_utf8_line_index updated;
+    my_utf8_line_index rebuilt;
+    my_utf8_line_index_build(&updated, oldText, -1);
+    my_utf8_line_index_build(&rebuilt, newText, -1);
+
+    int res = my_utf8_line_index_update(&updated, newText, -1, editStart, oldEnd, newEnd);
+    int same = (res == 0 && updated.lineCount == rebuilt.lineCount);
+    for (int j = 0; same && j <= rebuilt.lineCount; ++j) {
+        for (int k = 0; k < 3; ++k) {
+            same = same && updated.starts[k][j] == rebuilt.starts[k][j];
+        }
+        if (j < rebuilt.lineCount) {
+            same = same && updated.ascii[j] == rebuilt.ascii[j];
+        }
+    }
+
+    if (same) {
+        printf("PASSED: Old=\"%s\", New=\"%s\", Lines=%d\n", oldText, newText, rebuilt.lineCount);
+    }
+    else {
+        printf("FAILED: Old=\"%s\", New=\"%s\", Lines=%d\n", oldText, newText, rebuilt.lineCount);
+    }
+
+    my_utf8_line_index_free(&updated);
+    my_utf8_line_index_free(&rebuilt);
+}
+
+// count the nodes of a rope whose priority is above their parent's
+int test_utf8_rope_heap_errors(const my_utf8_rope_node *node) {
+    if (node == NULL) {
+        return 0;
+    }
+    int errors = 0;
+    if (node->left != NULL && node->left->priority > node->priority) {
+        errors++;
+    }
+    if (node->right != NULL && node->right->priority > node->priority) {
+        errors++;
+    }
+    return errors + test_utf8_rope_heap_errors(node->left) + test_utf8_rope_heap_errors(node->right);
+}
+
+// compare the text of a rope and its cached counts with the expected text,
+// and check that the tree is still heap-ordered by priority
+void test_utf8_rope(my_utf8_rope *rope, char *operation, unsigned char *expected) {
+    int len = (int)strlen((char *)expected);
+    unsigned char *output = (unsigned char*)malloc(len + 1);
+    int res = my_utf8_rope_slice(rope, 0, my_utf8_rope_length(rope, MY_UTF8_OFFSET_CHAR), output, len + 1);
+
+    my_utf8_line_index index;
+    my_utf8_line_index_build(&index, expected, len);
+    int same = (res == len && memcmp(output, expected, len) == 0 &&
+                my_utf8_rope_length(rope, MY_UTF8_OFFSET_BYTE) == len &&
+                my_utf8_rope_length(rope, MY_UTF8_OFFSET_CHAR) == index.starts[MY_UTF8_OFFSET_CHAR][index.lineCount] &&
+                my_utf8_rope_length(rope, MY_UTF8_OFFSET_UTF16) == index.starts[MY_UTF8_OFFSET_UTF16][index.lineCount] &&
+                my_utf8_rope_length(rope, MY_UTF8_ROPE_NEWLINES) == index.lineCount - 1 &&
+                test_utf8_rope_heap_errors(rope->root) == 0);
+
+    if (same) {
+        printf("PASSED: Operation=%s, Bytes=%d, Lines=%d\n", operation, len, index.lineCount);
+    }
+    else {
+        printf("FAILED: Operation=%s, Bytes=%d, Lines=%d, Result=%d\n", operation, len, index.lineCount, res);
+    }
+
+    my_utf8_line_index_free(&index);
+    free(output);
+}
+
+void test_utf8_rope_result(char *operation, int expected, int res) {
+    if (res == expected) {
+        printf("PASSED: Operation=%s, Expected=%d, Result=%d\n", operation, expected, res);
+    }
+    else {
+        printf("FAILED: Operation=%s, Expected=%d, Result=%d\n", operation, expected, res);
+    }
+}
+
+void test_utf8_anagram_groups(unsigned char **words, int count, int numThreads,
+                              int *expected, int expectedGroups) {
+    int groupIds[16];
+    int res = my_utf8_anagram_groups(words, count, numThreads, groupIds);
+
+    int same = (res == expectedGroups);
+    for (int i = 0; same && i < count; ++i) {
+        same = (groupIds[i] == expected[i]);
+    }
+
+    printf("%s: Words=%d, Threads=%d, Expected groups=%d, Result=%d, Ids=",
+           same ? "PASSED" : "FAILED", count, numThreads, expectedGroups, res);
+    for (int i = 0; res >= 0 && i < count; ++i) {
+        printf("%d ", groupIds[i]);
+    }
+    printf("\n");
+}
+
+void test_utf8_stats_counter(char *name, unsigned long long before, unsigned long long after,
+                             unsigned long long expected) {
+    if (after - before == expected) {
+        printf("PASSED: Counter=%s, Expected=+%llu, Result=+%llu\n", name, expected, after - before);
+    }
+    else {
+        printf("FAILED: Counter=%s, Expected=+%llu, Result=+%llu\n", name, expected, after - before);
+    }
+}
+
+// thread body for the statistics test: counters of other threads are included
+void *test_utf8_stats_thread(void *arg) {
+    my_utf8_strlen((unsigned char *)arg);
+    return NULL;
+}
+
+#ifdef MY_UTF8_STATS
+// number of threads whose counters are on the list (exited ones are not)
+int test_utf8_stats_listed(void) {
+    int listed = 0;
+    pthread_mutex_lock(&statsLock);
+    for (threadStats *t = allThreadStats; t != NULL; t = t->next) {
+        listed++;
+    }
+    pthread_mutex_unlock(&statsLock);
+    return listed;
+}
+#endif
+
+void test_utf8_check_bytes(unsigned char *input, int len, int expected) {
+    int res = my_utf8_check_bytes(input, len);
+
+    if (res == expected) {
+        printf("PASSED: Input=\"%s\", Len=%d, Expected=%d, Result=%d\n", input, len, expected, res);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", Len=%d, Expected=%d, Result=%d\n", input, len, expected, res);
+    }
+}
+
+void test_utf8_strlen_bytes(unsigned char *input, int len, int expected) {
+    int res = my_utf8_strlen_bytes(input, len);
+
+    if (res == expected) {
+        printf("PASSED: Input=\"%s\", Len=%d, Expected=%d, Result=%d\n", input, len, expected, res);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", Len=%d, Expected=%d, Result=%d\n", input, len, expected, res);
+    }
+}
+
+void test_utf8_sanitize_bytes(unsigned char *input, int len, unsigned char *expected) {
+    unsigned char output[100];
+    int res = my_utf8_sanitize_bytes(input, len, output);
+
+    if (res == (int)strlen((char *)expected) && memcmp(output, expected, res) == 0) {
+        printf("PASSED: Input=\"%s\", Expected=\"%s\", Output=\"%.*s\"\n", input, expected, res, output);
+    }
+    else {
+        printf("FAILED: Input=\"%s\", Expected=\"%s\", Output=\"%.*s\"\n", input, expected,
+               res < 0 ? 0 : res, output);
+    }
+}
+
+void test_all_utf8_encode(){
+    printf("Testing my_utf8_encode:\n");
+    test_utf8_encode((unsigned char*)"", (unsigned char*)"");
+    test_utf8_encode((unsigned char*)"A", (unsigned char*)"A");
+    test_utf8_encode((unsigned char*)"Hello", (unsigned char*)"Hello");
+    test_utf8_encode((unsigned char*)"\\u1846", (unsigned char*)"ᡆ");
+    test_utf8_encode((unsigned char*)"\\u10D2\\u10D0\\u10DB\\u10D0\\u10E0\\u10EF\\u10DD\\u10D1\\u10D0",
+                     (unsigned char*)"გამარჯობა");
+    test_utf8_encode((unsigned char*)"\\u103a8", (unsigned char*)"𐎨");
     test_utf8_encode((unsigned char*)"\\uZZZZ", (unsigned char*)"\\uZZZZ");
     test_utf8_encode((unsigned char*)"\\u1f632\\u1f634", (unsigned char*)"😲😴");
     test_utf8_encode((unsigned char*)"Hello \\u05D0\\u05E8\\u05D9\\u05D4 \\u1F601",
@@ -815,6 +3083,325 @@ void test_all_utf8_anagram_checker(){
     test_utf8_anagram_checker((unsigned char*)"Δοκιμές", (unsigned char*) "  Δοκιμές ", 0);
 }
 
+void test_all_utf8_anagram_groups(){
+    printf("\nTesting my_utf8_anagram_groups():\n");
+    unsigned char *words[] = {
+        (unsigned char*)"listen", (unsigned char*)"silent", (unsigned char*)"google",
+        (unsigned char*)"是的中國", (unsigned char*)"enlist", (unsigned char*)"國中是的",
+        (unsigned char*)"abc", (unsigned char*)"\xFF", (unsigned char*)"cab",
+        (unsigned char*)"", (unsigned char*)"😲😴😲", (unsigned char*)"😴😲😲"
+    };
+    int expected[] = {0, 0, 1, 2, 0, 2, 3, -1, 3, 4, 5, 5};
+
+    test_utf8_anagram_groups(words, 12, 1, expected, 6);
+    test_utf8_anagram_groups(words, 12, 3, expected, 6);
+    test_utf8_anagram_groups(words, 12, 12, expected, 6);
+    test_utf8_anagram_groups(words, 12, 0, expected, 6);
+    test_utf8_anagram_groups(words, 0, 4, expected, 0);
+}
+
+void test_all_utf8_check_bytes(){
+    printf("\nTesting my_utf8_check_bytes:\n");
+    test_utf8_check_bytes((unsigned char*)"", 0, 0);
+    test_utf8_check_bytes((unsigned char*)"Hello, plain ASCII text", 23, 23);
+    test_utf8_check_bytes((unsigned char*)"한국어 문장", 16, 16);
+    test_utf8_check_bytes((unsigned char*)"a\0b", 3, 3); // null bytes are allowed
+    test_utf8_check_bytes((unsigned char*)"\xc2\x80\xe0\xa0\x80", 5, 5); // U+0080, U+0800
+    test_utf8_check_bytes((unsigned char*)"\xf4\x8f\xbf\xbf", 4, 4); // U+10FFFF
+    test_utf8_check_bytes((unsigned char*)"ab\xC0\x80", 4, 2); // overlong
+    test_utf8_check_bytes((unsigned char*)"\xE0\x9F\xBF", 3, 0); // overlong
+    test_utf8_check_bytes((unsigned char*)"ok \xED\xA0\x80", 6, 3); // surrogate
+    test_utf8_check_bytes((unsigned char*)"\xF4\x90\x80\x80", 4, 0); // above U+10FFFF
+    test_utf8_check_bytes((unsigned char*)"abc\xe2\x86", 5, 3); // cut off
+    test_utf8_check_bytes((unsigned char*)"abc", -1, -1);
+}
+
+void test_all_utf8_strlen_bytes(){
+    printf("\nTesting my_utf8_strlen_bytes:\n");
+    test_utf8_strlen_bytes((unsigned char*)"", 0, 0);
+    test_utf8_strlen_bytes((unsigned char*)"Hello שלום", 14, 10);
+    test_utf8_strlen_bytes((unsigned char*)"😞😭 and some more ASCII", 26, 20);
+    test_utf8_strlen_bytes((unsigned char*)"a\0b", 3, 3);
+    test_utf8_strlen_bytes((unsigned char*)"abc", -1, -1);
+}
+
+void test_all_utf8_sanitize_bytes(){
+    printf("\nTesting my_utf8_sanitize_bytes:\n");
+    test_utf8_sanitize_bytes((unsigned char*)"", 0, (unsigned char*)"");
+    test_utf8_sanitize_bytes((unsigned char*)"Hello אריה 😁", 19, (unsigned char*)"Hello אריה 😁");
+    test_utf8_sanitize_bytes((unsigned char*)"a\xFF" "b", 3, (unsigned char*)"a\xef\xbf\xbd" "b");
+    test_utf8_sanitize_bytes((unsigned char*)"\xC0\x80", 2, (unsigned char*)"\xef\xbf\xbd\xef\xbf\xbd");
+    test_utf8_sanitize_bytes((unsigned char*)"long ASCII run \xED\xA0\x80!", 19,
+                             (unsigned char*)"long ASCII run \xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd!");
+}
+
+void test_all_utf8_substr(){
+    printf("\nTesting my_utf8_substr:\n");
+    test_utf8_substr((unsigned char*)"", 0, 0, (unsigned char*)"");
+    test_utf8_substr((unsigned char*)"Hello", 1, 3, (unsigned char*)"ell");
+    test_utf8_substr((unsigned char*)"Hello", 3, 10, (unsigned char*)"lo");
+    test_utf8_substr((unsigned char*)"Hello", 5, 1, (unsigned char*)"");
+    test_utf8_substr((unsigned char*)"Language Язык", 9, 2, (unsigned char*)"Яз");
+    test_utf8_substr((unsigned char*)"😞😭😁", 1, 1, (unsigned char*)"😭");
+    test_utf8_substr((unsigned char*)"abcdefghijklmnopqrstuvwxyz שלום עולם", 27, 4,
+                     (unsigned char*)"שלום");
+    test_utf8_substr((unsigned char*)"ສະບາຍດີ ສະບາຍດີ ສະບາຍດີ", 16, 7,
+                     (unsigned char*)"ສະບາຍດີ");
+    // invalid start
+    test_utf8_substr((unsigned char*)"Hello", 6, 1, NULL);
+    test_utf8_substr((unsigned char*)"テスト", 4, 0, NULL);
+    test_utf8_substr((unsigned char*)"Hello", -1, 1, NULL);
+}
+
+void test_all_utf8_truncate_bytes(){
+    printf("\nTesting my_utf8_truncate_bytes:\n");
+    test_utf8_truncate_bytes((unsigned char*)"", 4, 0);
+    test_utf8_truncate_bytes((unsigned char*)"Hello", 10, 5);
+    test_utf8_truncate_bytes((unsigned char*)"Hello", 5, 5);
+    test_utf8_truncate_bytes((unsigned char*)"Hello", 3, 3);
+    test_utf8_truncate_bytes((unsigned char*)"Hello", 0, 0);
+    test_utf8_truncate_bytes((unsigned char*)"Язык", 3, 2); // cut inside "з"
+    test_utf8_truncate_bytes((unsigned char*)"Язык", 4, 4);
+    test_utf8_truncate_bytes((unsigned char*)"a😁", 4, 1); // cut inside the emoji
+    test_utf8_truncate_bytes((unsigned char*)"a😁", 5, 5);
+    test_utf8_truncate_bytes((unsigned char*)"テスト", 8, 6);
+    test_utf8_truncate_bytes((unsigned char*)"a\x80\x80\x80" "b", 3, 3); // stray continuation bytes
+    test_utf8_truncate_bytes((unsigned char*)"a\x80\x80\x80\x80" "b", 4, 4);
+    test_utf8_truncate_bytes((unsigned char*)"\xc3\xa9\x80\x80", 3, 3); // é and stray bytes
+    test_utf8_truncate_bytes((unsigned char*)"Hello", -1, -1);
+}
+
+void test_all_utf8_rope(){
+    printf("\nTesting my_utf8_rope:\n");
+    my_utf8_rope rope;
+    unsigned char slice[32];
+
+    my_utf8_rope_init(&rope, (unsigned char*)"héllo\nwörld 😀", -1);
+    test_utf8_rope(&rope, "init", (unsigned char*)"héllo\nwörld 😀");
+    my_utf8_rope_insert(&rope, 5, (unsigned char*)" there", -1);
+    test_utf8_rope(&rope, "insert in the middle", (unsigned char*)"héllo there\nwörld 😀");
+    my_utf8_rope_insert(&rope, 0, (unsigned char*)"¡", -1);
+    my_utf8_rope_insert(&rope, 20, (unsigned char*)"!\n", -1);
+    test_utf8_rope(&rope, "insert at both ends", (unsigned char*)"¡héllo there\nwörld 😀!\n");
+    my_utf8_rope_delete(&rope, 6, 6);
+    test_utf8_rope(&rope, "delete", (unsigned char*)"¡héllo\nwörld 😀!\n");
+    my_utf8_rope_delete(&rope, 13, 100);
+    test_utf8_rope(&rope, "delete past the end", (unsigned char*)"¡héllo\nwörld ");
+
+    test_utf8_rope_result("slice", 6, my_utf8_rope_slice(&rope, 7, 5, slice, sizeof(slice)));
+    test_utf8_rope_result("slice text", 1, compare_strings(slice, (unsigned char*)"wörld"));
+    test_utf8_rope_result("slice too small", -1, my_utf8_rope_slice(&rope, 0, 13, slice, 8));
+    test_utf8_rope_result("insert invalid UTF-8", -1, my_utf8_rope_insert(&rope, 0, (unsigned char*)"\xFF", -1));
+    test_utf8_rope_result("insert out of bounds", -1, my_utf8_rope_insert(&rope, 14, (unsigned char*)"x", -1));
+    test_utf8_rope_result("char to byte", 9, my_utf8_rope_offset_convert(&rope, 7, MY_UTF8_OFFSET_CHAR, MY_UTF8_OFFSET_BYTE));
+    test_utf8_rope_result("byte inside é to char", 2, my_utf8_rope_offset_convert(&rope, 4, MY_UTF8_OFFSET_BYTE, MY_UTF8_OFFSET_CHAR));
+    test_utf8_rope_result("line of char", 1, my_utf8_rope_line_of(&rope, 7, MY_UTF8_OFFSET_CHAR));
+    test_utf8_rope_result("line start", 7, my_utf8_rope_line_start(&rope, 1, MY_UTF8_OFFSET_CHAR));
+    test_utf8_rope_result("missing line", -1, my_utf8_rope_line_start(&rope, 2, MY_UTF8_OFFSET_CHAR));
+    my_utf8_rope_free(&rope);
+
+    // a text of many chunks, edited the same way as a flat copy
+    const char *piece = "aé😀\n";
+    int pieces = 3000;
+    int pieceBytes = (int)strlen(piece);
+    unsigned char *flat = (unsigned char*)malloc(pieces * pieceBytes + 64);
+    for (int i = 0; i < pieces; ++i) {
+        memcpy(flat + i * pieceBytes, piece, pieceBytes);
+    }
+    flat[pieces * pieceBytes] = '\0';
+    my_utf8_rope_init(&rope, flat, -1);
+    test_utf8_rope(&rope, "init many chunks", flat);
+
+    // insert "中文" before character 5001, the "é" of piece 1250 (byte 10001)
+    int at = 10001;
+    memmove(flat + at + 6, flat + at, strlen((char *)flat + at) + 1);
+    memcpy(flat + at, "中文", 6);
+    my_utf8_rope_insert(&rope, 5001, (unsigned char*)"中文", -1);
+    test_utf8_rope(&rope, "insert into a chunk", flat);
+
+    // delete 401 characters (100 pieces and the "a" after them) from character 2000
+    memmove(flat + 4000, flat + 4000 + 801, strlen((char *)flat + 4801) + 1);
+    my_utf8_rope_delete(&rope, 2000, 401);
+    test_utf8_rope(&rope, "delete across chunks", flat);
+    // 2900 pieces of 4 characters (5 UTF-16 units) are left, plus "中文" minus one "a"
+    test_utf8_rope_result("line start after edits", 2900 * 4 + 1, my_utf8_rope_line_start(&rope, 2900, MY_UTF8_OFFSET_CHAR));
+    test_utf8_rope_result("UTF-16 length", 2900 * 5 + 1, my_utf8_rope_length(&rope, MY_UTF8_OFFSET_UTF16));
+
+    // many small edits spread over the text; every delete splits chunks
+    int heapErrors = 0;
+    for (int i = 0; i < 1000; ++i) {
+        int len = (int)strlen((char *)flat);
+        int charPos = (i * 7919) % (my_utf8_strlen_bytes(flat, len) + 1);
+        my_utf8_view edit = my_utf8_substr(flat, len, charPos, (i % 2) ? 5 : 0);
+        int bytePos = (int)(edit.data - flat);
+        if (i % 2) {
+            memmove(flat + bytePos, flat + bytePos + edit.bytes, len - bytePos - edit.bytes + 1);
+            my_utf8_rope_delete(&rope, charPos, 5);
+        }
+        else {
+            memmove(flat + bytePos + 4, flat + bytePos, len - bytePos + 1);
+            memcpy(flat + bytePos, "中x", 4);
+            my_utf8_rope_insert(&rope, charPos, (unsigned char*)"中x", -1);
+        }
+        heapErrors += test_utf8_rope_heap_errors(rope.root);
+    }
+    test_utf8_rope(&rope, "1000 mixed edits", flat);
+    test_utf8_rope_result("heap order after every edit", 0, heapErrors);
+    my_utf8_rope_free(&rope);
+    free(flat);
+}
+
+void test_all_utf8_stats(){
+    printf("\nTesting my_utf8_stats_snapshot:\n");
+    my_utf8_stats before;
+    my_utf8_stats after;
+    int res = my_utf8_stats_snapshot(&before);
+
+#ifdef MY_UTF8_STATS
+    if (res == 0) {
+        printf("PASSED: Statistics compiled in, Expected=0, Result=%d, Kernel=%s\n", res, before.kernel);
+    }
+    else {
+        printf("FAILED: Statistics compiled in, Expected=0, Result=%d, Kernel=%s\n", res, before.kernel);
+    }
+
+    pthread_t thread;
+    my_utf8_strlen((unsigned char*)"Hello שלום");
+    my_utf8_check((unsigned char*)"ab\xFF");
+    pthread_create(&thread, NULL, test_utf8_stats_thread, "😞😭");
+    pthread_join(thread, NULL);
+    my_utf8_stats_snapshot(&after);
+
+    my_utf8_counters *b = &before.functions[MY_UTF8_FN_STRLEN];
+    my_utf8_counters *a = &after.functions[MY_UTF8_FN_STRLEN];
+    test_utf8_stats_counter("strlen calls", b->calls, a->calls, 2);
+    test_utf8_stats_counter("strlen bytes", b->bytes, a->bytes, 22);
+    test_utf8_stats_counter("strlen asciiBytes", b->asciiBytes, a->asciiBytes, 6);
+    test_utf8_stats_counter("strlen multiByteBytes", b->multiByteBytes, a->multiByteBytes, 16);
+    b = &before.functions[MY_UTF8_FN_CHECK];
+    a = &after.functions[MY_UTF8_FN_CHECK];
+    test_utf8_stats_counter("check calls", b->calls, a->calls, 1);
+    test_utf8_stats_counter("check errors", b->errors, a->errors, 1);
+    test_utf8_stats_counter("check bytes", b->bytes, a->bytes, 2);
+
+    // bytes looked at until the character is found or the strings differ
+    my_utf8_stats_snapshot(&before);
+    my_utf8_charat((unsigned char*)"héllo", 2);
+    my_utf8_charat((unsigned char*)"h€", 1);
+    my_utf8_strcmp((unsigned char*)"héllo", (unsigned char*)"héllo");
+    my_utf8_strcmp((unsigned char*)"ab", (unsigned char*)"ac");
+    my_utf8_stats_snapshot(&after);
+    b = &before.functions[MY_UTF8_FN_CHARAT];
+    a = &after.functions[MY_UTF8_FN_CHARAT];
+    test_utf8_stats_counter("charat bytes", b->bytes, a->bytes, 4 + 4);
+    b = &before.functions[MY_UTF8_FN_STRCMP];
+    a = &after.functions[MY_UTF8_FN_STRCMP];
+    test_utf8_stats_counter("strcmp calls", b->calls, a->calls, 2);
+    test_utf8_stats_counter("strcmp bytes", b->bytes, a->bytes, 12 + 4);
+    test_utf8_stats_counter("strcmp asciiBytes", b->asciiBytes, a->asciiBytes, 6 + 4);
+    test_utf8_stats_counter("strcmp multiByteBytes", b->multiByteBytes, a->multiByteBytes, 6);
+
+    // worker threads of my_utf8_anagram_groups leave their counts behind
+    // when they exit, but not their counters
+    unsigned char *words[] = {(unsigned char*)"listen", (unsigned char*)"silent",
+                              (unsigned char*)"élan", (unsigned char*)"lané"};
+    int groupIds[4];
+    int listed = test_utf8_stats_listed();
+    my_utf8_stats_snapshot(&before);
+    for (int k = 0; k < 1000; ++k) {
+        my_utf8_anagram_groups(words, 4, 4, groupIds);
+    }
+    my_utf8_stats_snapshot(&after);
+    b = &before.functions[MY_UTF8_FN_ANAGRAM_GROUPS];
+    a = &after.functions[MY_UTF8_FN_ANAGRAM_GROUPS];
+    test_utf8_stats_counter("anagram_groups calls", b->calls, a->calls, 1000);
+    test_utf8_stats_counter("anagram_groups bytes", b->bytes, a->bytes, 1000 * 22);
+    test_utf8_stats_counter("threads listed", listed, test_utf8_stats_listed(), 0);
+#else
+    // compiled without statistics: the snapshot is empty
+    if (res == -1 && before.functions[MY_UTF8_FN_STRLEN].calls == 0) {
+        printf("PASSED: Statistics compiled out, Expected=-1, Result=%d\n", res);
+    }
+    else {
+        printf("FAILED: Statistics compiled out, Expected=-1, Result=%d\n", res);
+    }
+    (void)after;
+#endif
+}
+
+void test_all_utf8_display_width(){
+    printf("\nTesting my_utf8_display_width:\n");
+    test_utf8_display_width((unsigned char*)"", 0);
+    test_utf8_display_width((unsigned char*)"Hello", 5);
+    test_utf8_display_width((unsigned char*)"A longer line of plain ASCII text", 33);
+    test_utf8_display_width((unsigned char*)"tab\there", 7); // control characters take no columns
+    test_utf8_display_width((unsigned char*)"中文", 4);
+    test_utf8_display_width((unsigned char*)"한국어 문장", 11);
+    test_utf8_display_width((unsigned char*)"ｆｕｌｌ", 8);
+    test_utf8_display_width((unsigned char*)"ສະບາຍດີ", 6); // vowel sign ີ is combining
+    test_utf8_display_width((unsigned char*)"e\xcc\x81", 1); // e + combining acute accent
+    test_utf8_display_width((unsigned char*)"😀", 2);
+    test_utf8_display_width((unsigned char*)"\xe2\x9d\xa4\xef\xb8\x8f", 2); // heart + emoji presentation
+    test_utf8_display_width((unsigned char*)"👍🏽", 2); // skin tone modifier
+    test_utf8_display_width((unsigned char*)"👨‍👩‍👧", 2); // zero width joiner sequence
+    test_utf8_display_width((unsigned char*)"🇺🇸", 2); // flag
+    test_utf8_display_width((unsigned char*)"🇺🇸🇫", 4); // flag and a lone regional indicator
+    test_utf8_display_width((unsigned char*)"a\xe1\xb3\x94" "b", 2); // Vedic sign U+1CD4 is combining
+    test_utf8_display_width((unsigned char*)"\xe2\x81\xa6x\xe2\x81\xa9", 1); // bidi isolates are format characters
+    test_utf8_display_width((unsigned char*)"\xea\xb0\x80\xed\x9e\xb0", 2); // Hangul Jamo Extended-B vowel
+    test_utf8_display_width((unsigned char*)"\xe4\xb7\x80", 2); // hexagram symbol U+4DC0 is wide
+    test_utf8_display_width((unsigned char*)"\xe0\xa3\xa2", 1); // U+08E2 is a prepended mark, not zero-width
+    test_utf8_display_width((unsigned char*)"Hello אריה 😁", 13);
+    test_utf8_display_width((unsigned char*)"\xFF", -1); // invalid UTF-8
+}
+
+void test_all_utf8_truncate_columns(){
+    printf("\nTesting my_utf8_truncate_columns:\n");
+    test_utf8_truncate_columns((unsigned char*)"", 3, 0);
+    test_utf8_truncate_columns((unsigned char*)"abc", 2, 2);
+    test_utf8_truncate_columns((unsigned char*)"A longer line of plain ASCII text", 12, 12);
+    test_utf8_truncate_columns((unsigned char*)"中文字", 5, 6);
+    test_utf8_truncate_columns((unsigned char*)"中文字", 6, 9);
+    test_utf8_truncate_columns((unsigned char*)"e\xcc\x81x", 1, 3); // keeps the combining accent
+    test_utf8_truncate_columns((unsigned char*)"a\xe2\x9d\xa4\xef\xb8\x8f", 2, 1); // drops the whole emoji
+    test_utf8_truncate_columns((unsigned char*)"👨‍👩‍👧!", 2, 18);
+    test_utf8_truncate_columns((unsigned char*)"🇺🇸x", 2, 8); // keeps the whole flag
+    test_utf8_truncate_columns((unsigned char*)"🇺🇸x", 1, 0);
+    test_utf8_truncate_columns((unsigned char*)"abc", -1, -1);
+}
+
+void test_all_utf8_line_index(){
+    printf("\nTesting my_utf8_offset_convert:\n");
+    // line 0: "plain ascii line\n" (bytes 0-16)
+    // line 1: "héllo wörld 😀!\n"  (bytes 17-36, chars 17-31, UTF-16 17-32)
+    // line 2: "end"               (bytes 37-39, chars 32-34, UTF-16 33-35)
+    unsigned char *text = (unsigned char*)"plain ascii line\nhéllo wörld 😀!\nend";
+    my_utf8_line_index index;
+    my_utf8_line_index_build(&index, text, -1);
+
+    test_utf8_offset_convert(&index, 5, MY_UTF8_OFFSET_BYTE, MY_UTF8_OFFSET_CHAR, 5);
+    test_utf8_offset_convert(&index, 17, MY_UTF8_OFFSET_BYTE, MY_UTF8_OFFSET_UTF16, 17);
+    test_utf8_offset_convert(&index, 20, MY_UTF8_OFFSET_BYTE, MY_UTF8_OFFSET_CHAR, 19); // after "hé"
+    test_utf8_offset_convert(&index, 19, MY_UTF8_OFFSET_BYTE, MY_UTF8_OFFSET_CHAR, 18); // inside "é"
+    test_utf8_offset_convert(&index, 35, MY_UTF8_OFFSET_BYTE, MY_UTF8_OFFSET_UTF16, 31); // after emoji
+    test_utf8_offset_convert(&index, 30, MY_UTF8_OFFSET_CHAR, MY_UTF8_OFFSET_UTF16, 31);
+    test_utf8_offset_convert(&index, 31, MY_UTF8_OFFSET_UTF16, MY_UTF8_OFFSET_BYTE, 35);
+    test_utf8_offset_convert(&index, 30, MY_UTF8_OFFSET_UTF16, MY_UTF8_OFFSET_BYTE, 31); // inside surrogate pair
+    test_utf8_offset_convert(&index, 34, MY_UTF8_OFFSET_CHAR, MY_UTF8_OFFSET_BYTE, 39);
+    test_utf8_offset_convert(&index, 36, MY_UTF8_OFFSET_UTF16, MY_UTF8_OFFSET_CHAR, 35); // end of text
+    test_utf8_offset_convert(&index, 41, MY_UTF8_OFFSET_BYTE, MY_UTF8_OFFSET_CHAR, -1); // out of bounds
+    test_utf8_offset_convert(&index, -1, MY_UTF8_OFFSET_CHAR, MY_UTF8_OFFSET_BYTE, -1);
+    my_utf8_line_index_free(&index);
+
+    printf("\nTesting my_utf8_line_index_update:\n");
+    test_utf8_line_index_update((unsigned char*)"abc\ndef\nghi", (unsigned char*)"abXc\ndef\nghi", 2, 2, 3);
+    test_utf8_line_index_update((unsigned char*)"abc\ndef\nghi", (unsigned char*)"abc\nd\nπ\nf\nghi", 5, 6, 9);
+    test_utf8_line_index_update((unsigned char*)"abc\ndéf\nghi", (unsigned char*)"abhi", 2, 10, 2);
+    test_utf8_line_index_update((unsigned char*)"abc\ndef\nghi", (unsigned char*)"abc\ndef\nghi😀\n", 11, 11, 16);
+    test_utf8_line_index_update((unsigned char*)"Язык\nязык\n", (unsigned char*)"\nЯзык\nязык\n", 0, 0, 1);
+    test_utf8_line_index_update((unsigned char*)"", (unsigned char*)"новый\nтекст", 0, 0, 21);
+}
+
 int main() {
     test_all_utf8_encode();
     test_all_utf8_decode();
@@ -824,6 +3411,19 @@ int main() {
     test_all_utf8_strcmp();
     test_all_utf8_remove_whitespace();
     test_all_utf8_anagram_checker();
+    test_all_utf8_anagram_groups();
+    test_all_utf8_check_bytes();
+    test_all_utf8_strlen_bytes();
+    test_all_utf8_sanitize_bytes();
+    test_all_utf8_substr();
+    test_all_utf8_truncate_bytes();
+    test_all_utf8_display_width();
+    test_all_utf8_truncate_columns();
+    test_all_utf8_line_index();
+    test_all_utf8_rope();
+    test_all_utf8_stats();
 
     return 0;
-}
\ No newline at end of file
+}
+
+#endif // MY_UTF8_NO_TESTS
@@ -0,0 +1,153 @@
+// my_utf8.h - UTF-8 string functions implemented in my_utf8.c
+//
+// Build the library without its test main() by defining MY_UTF8_NO_TESTS,
+// and with per-thread statistics by defining MY_UTF8_STATS.
+#ifndef MY_UTF8_H
+#define MY_UTF8_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// byte view into an existing UTF-8 string (no copy, not null-terminated)
+typedef struct {
+    unsigned const char *data; // first byte of the view (NULL on error)
+    int bytes;                 // number of bytes in the view
+} my_utf8_view;
+
+// kinds of offsets the line index can convert between
+#define MY_UTF8_OFFSET_BYTE  0 // UTF-8 bytes
+#define MY_UTF8_OFFSET_CHAR  1 // code points
+#define MY_UTF8_OFFSET_UTF16 2 // UTF-16 code units (LSP positions)
+
+// index of the lines in a UTF-8 text, used to convert between offset kinds
+typedef struct {
+    unsigned const char *text; // indexed text (not owned by the index)
+    int length;                // length of the text in bytes
+    int lineCount;             // number of lines (at least 1)
+    int capacity;              // number of entries allocated in the arrays
+    int *starts[3];            // line starts for each offset kind; entry
+                               // lineCount holds the end of the text
+    unsigned char *ascii;      // 1 if the line only contains ASCII
+} my_utf8_line_index;
+
+// count a rope keeps besides the MY_UTF8_OFFSET_* kinds
+#define MY_UTF8_ROPE_NEWLINES 3
+
+// largest chunk of text in a rope node, in bytes
+#define MY_UTF8_ROPE_CHUNK 1024
+
+typedef struct my_utf8_rope_node my_utf8_rope_node;
+
+// text buffer for large documents that are edited often. The text is kept in
+// chunks in a balanced tree whose nodes cache the bytes, characters, UTF-16
+// units and newlines below them, so edits and lookups by offset take O(log n).
+typedef struct {
+    my_utf8_rope_node *root; // NULL for an empty rope
+    unsigned int seed;       // state of the random priorities that balance the tree
+} my_utf8_rope;
+
+// entry points that keep statistics when compiled with -DMY_UTF8_STATS
+enum {
+    MY_UTF8_FN_ENCODE,
+    MY_UTF8_FN_DECODE,
+    MY_UTF8_FN_CHECK,
+    MY_UTF8_FN_STRLEN,
+    MY_UTF8_FN_CHARAT,
+    MY_UTF8_FN_STRCMP,
+    MY_UTF8_FN_REMOVE_WHITESPACE,
+    MY_UTF8_FN_ANAGRAM_CHECKER,
+    MY_UTF8_FN_ANAGRAM_GROUPS,
+    MY_UTF8_FN_SUBSTR,
+    MY_UTF8_FN_TRUNCATE_BYTES,
+    MY_UTF8_FN_DISPLAY_WIDTH,
+    MY_UTF8_FN_TRUNCATE_COLUMNS,
+    MY_UTF8_FN_LINE_INDEX_BUILD,
+    MY_UTF8_FN_LINE_INDEX_UPDATE,
+    MY_UTF8_FN_OFFSET_CONVERT,
+    MY_UTF8_FN_CHECK_BYTES,
+    MY_UTF8_FN_STRLEN_BYTES,
+    MY_UTF8_FN_SANITIZE_BYTES,
+    MY_UTF8_FN_ROPE_INIT,
+    MY_UTF8_FN_ROPE_INSERT,
+    MY_UTF8_FN_ROPE_DELETE,
+    MY_UTF8_FN_ROPE_SLICE,
+    MY_UTF8_FN_COUNT
+};
+
+// counters for one entry point
+typedef struct {
+    unsigned long long calls;          // number of calls
+    unsigned long long bytes;          // bytes of input looked at
+    unsigned long long asciiBytes;     // bytes handled by an ASCII fast path
+    unsigned long long multiByteBytes; // bytes handled by the multi-byte path
+    unsigned long long errors;         // invalid input or encoding errors found
+    unsigned long long allocations;    // memory allocations made
+} my_utf8_counters;
+
+// totals of the counters of all threads
+typedef struct {
+    my_utf8_counters functions[MY_UTF8_FN_COUNT];
+    const char *kernel; // word-at-a-time kernel the library was built with
+} my_utf8_stats;
+
+// the bulk kernels work on 8-byte words in portable C, so there is only one
+#define MY_UTF8_KERNEL "swar64"
+
+// encoding and decoding
+int my_utf8_encode(unsigned char *input, unsigned char *output);
+int my_utf8_decode(unsigned char *input, unsigned char *output);
+int my_utf8_decode_next(unsigned const char *str, int len, int *codePoint);
+
+// validation, length and access
+int my_utf8_check(unsigned char *string);
+int my_utf8_check_bytes(unsigned const char *str, int len);
+int my_utf8_strlen(unsigned char *string);
+int my_utf8_strlen_bytes(unsigned const char *str, int len);
+unsigned char *my_utf8_charat(unsigned const char *string, int index);
+int my_utf8_strcmp(unsigned char *string1, unsigned char *string2);
+int my_utf8_sanitize_bytes(unsigned const char *str, int len, unsigned char *output);
+
+// extra functions
+unsigned char* my_utf8_remove_whitespace(unsigned const char *input);
+int my_utf8_anagram_checker(unsigned char *str1, unsigned char *str2);
+int my_utf8_anagram_groups(unsigned char **words, int count, int numThreads, int *groupIds);
+
+// substrings and truncation
+my_utf8_view my_utf8_substr(unsigned const char *str, int len, int charStart, int charCount);
+int my_utf8_truncate_bytes(unsigned const char *str, int maxBytes);
+
+// display width
+int my_utf8_codepoint_width(int codePoint);
+int my_utf8_display_width(unsigned const char *str);
+int my_utf8_truncate_columns(unsigned const char *str, int maxColumns);
+
+// line index and offset conversion
+int my_utf8_line_index_build(my_utf8_line_index *index, unsigned const char *text, int len);
+int my_utf8_line_index_update(my_utf8_line_index *index, unsigned const char *newText, int newLen,
+                              int editStart, int oldEnd, int newEnd);
+void my_utf8_line_index_free(my_utf8_line_index *index);
+int my_utf8_line_of(const my_utf8_line_index *index, int offset, int kind);
+int my_utf8_offset_convert(const my_utf8_line_index *index, int offset, int from, int to);
+
+// rope text buffer
+int my_utf8_rope_init(my_utf8_rope *rope, unsigned const char *text, int len);
+void my_utf8_rope_free(my_utf8_rope *rope);
+int my_utf8_rope_length(const my_utf8_rope *rope, int kind);
+int my_utf8_rope_insert(my_utf8_rope *rope, int charIndex, unsigned const char *text, int len);
+int my_utf8_rope_delete(my_utf8_rope *rope, int charIndex, int charCount);
+int my_utf8_rope_slice(const my_utf8_rope *rope, int charIndex, int charCount,
+                       unsigned char *output, int outputSize);
+int my_utf8_rope_offset_convert(const my_utf8_rope *rope, int offset, int from, int to);
+int my_utf8_rope_line_of(const my_utf8_rope *rope, int offset, int kind);
+int my_utf8_rope_line_start(const my_utf8_rope *rope, int line, int kind);
+
+// statistics
+const char *my_utf8_stats_name(int fn);
+int my_utf8_stats_snapshot(my_utf8_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MY_UTF8_H
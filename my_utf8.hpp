@@ -0,0 +1,458 @@
+// my_utf8.hpp - header-only C++20 layer over the functions in my_utf8.c
+//
+// Takes std::string_view, std::u8string_view and std::span<const char8_t>
+// directly, so callers do not convert to unsigned char* or copy into
+// null-terminated buffers. check, valid_prefix, length and decode_next are
+// constexpr, so string literals can be validated at compile time:
+//
+//     static_assert(my_utf8::check(u8"héllo"));
+//     constexpr auto greeting = my_utf8::checked("héllo"); // error if invalid
+//
+// At run time check and length call my_utf8_check_bytes and
+// my_utf8_strlen_bytes (the 8-byte kernels in my_utf8.c), so link my_utf8.c
+// built with -DMY_UTF8_NO_TESTS. code_points() and graphemes() are ranges that
+// work with <algorithm> and <ranges>.
+//
+// Tests: test_my_utf8.cpp
+#ifndef MY_UTF8_HPP
+#define MY_UTF8_HPP
+
+#include <climits>
+#include <cstddef>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+#include "my_utf8.h"
+
+namespace my_utf8 {
+
+// result of decoding one character
+struct decoded {
+    char32_t code_point; // decoded code point (0 unless bytes > 0)
+    int bytes;           // bytes used, 0 if cut off at the end, -1 if invalid
+};
+
+// code point that invalid bytes decode to in code_points()
+inline constexpr char32_t replacement = 0xFFFD;
+
+namespace detail {
+
+// character types the layer accepts
+template <class CharT>
+concept byte_char = std::is_same_v<CharT, char> || std::is_same_v<CharT, char8_t>;
+
+template <byte_char CharT>
+constexpr unsigned byte(CharT c) noexcept {
+    return static_cast<unsigned char>(c);
+}
+
+// number of bytes in a character, from its first byte (0 if it cannot start one)
+constexpr int sequence_length(unsigned first) noexcept {
+    if (first < 0x80) {
+        return 1;
+    }
+    if (first >= 0xC2 && first <= 0xDF) { // C0, C1 are always overlong
+        return 2;
+    }
+    if ((first & 0xF0) == 0xE0) {
+        return 3;
+    }
+    if (first >= 0xF0 && first <= 0xF4) { // above F4 is past U+10FFFF
+        return 4;
+    }
+    return 0;
+}
+
+// view of a C++ string as the unsigned char pointer my_utf8.c takes (no copy)
+template <byte_char CharT>
+const unsigned char *bytes_of(const CharT *data) noexcept {
+    return reinterpret_cast<const unsigned char *>(data);
+}
+
+} // namespace detail
+
+// Decodes a character that is known to be N bytes long from the first N bytes
+// at p. Rejects overlong encodings, surrogates and code points above U+10FFFF
+// like my_utf8_decode_next. N is a template argument, so the masks for the
+// first byte and the smallest allowed value are constants.
+template <int N, detail::byte_char CharT>
+constexpr decoded decode_n(const CharT *p) noexcept {
+    static_assert(N >= 1 && N <= 4, "a UTF-8 character is 1 to 4 bytes long");
+    constexpr decoded invalid{0, -1};
+    unsigned first = detail::byte(p[0]);
+
+    if constexpr (N == 1) {
+        return (first < 0x80) ? decoded{first, 1} : invalid;
+    }
+    else {
+        // first byte is 110xxxxx, 1110xxxx or 11110xxx
+        constexpr unsigned leadMask = (0xFF00u >> (N + 1)) & 0xFF;
+        constexpr unsigned leadBits = (leadMask << 1) & 0xFF;
+        if ((first & leadMask) != leadBits) {
+            return invalid;
+        }
+
+        char32_t value = first & (0x7Fu >> N);
+        for (int j = 1; j < N; ++j) {
+            unsigned c = detail::byte(p[j]);
+            if ((c & 0xC0) != 0x80) {
+                return invalid; // not a continuation byte
+            }
+            value = (value << 6) | (c & 0x3F);
+        }
+
+        constexpr char32_t smallest = (N == 2) ? 0x80 : (N == 3) ? 0x800 : 0x10000;
+        if (value < smallest || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+            return invalid;
+        }
+        return {value, N};
+    }
+}
+
+// Decodes the character at the start of s. Same results as
+// my_utf8_decode_next: bytes is 0 if s ends in the middle of a valid
+// character and -1 if the bytes are not valid UTF-8.
+template <detail::byte_char CharT>
+constexpr decoded decode_next(std::basic_string_view<CharT> s) noexcept {
+    if (s.empty()) {
+        return {0, 0};
+    }
+    const CharT *p = s.data();
+    int need = detail::sequence_length(detail::byte(p[0]));
+    if (need == 0) {
+        return {0, -1};
+    }
+    if (s.size() < static_cast<std::size_t>(need)) {
+        // only report a cut off character if the bytes so far are valid
+        for (std::size_t j = 1; j < s.size(); ++j) {
+            if ((detail::byte(p[j]) & 0xC0) != 0x80) {
+                return {0, -1};
+            }
+        }
+        unsigned first = detail::byte(p[0]);
+        if (s.size() >= 2) {
+            unsigned second = detail::byte(p[1]);
+            if ((first == 0xE0 && second < 0xA0) || (first == 0xED && second > 0x9F) ||
+                (first == 0xF0 && second < 0x90) || (first == 0xF4 && second > 0x8F)) {
+                return {0, -1};
+            }
+        }
+        return {0, 0};
+    }
+    switch (need) {
+    case 1:
+        return decode_n<1>(p);
+    case 2:
+        return decode_n<2>(p);
+    case 3:
+        return decode_n<3>(p);
+    default:
+        return decode_n<4>(p);
+    }
+}
+
+// Returns the length in bytes of the longest valid UTF-8 prefix of s, like
+// my_utf8_check_bytes. A character cut off at the end counts as invalid.
+template <detail::byte_char CharT>
+constexpr std::size_t valid_prefix(std::basic_string_view<CharT> s) noexcept {
+    if (std::is_constant_evaluated()) {
+        std::size_t i = 0;
+        while (i < s.size()) {
+            int bytes = decode_next(s.substr(i)).bytes;
+            if (bytes <= 0) {
+                break;
+            }
+            i += bytes;
+        }
+        return i;
+    }
+
+    // my_utf8_check_bytes takes an int length, so go 1 GiB at a time; a
+    // character cut off at the end of a piece is checked again with the next
+    const unsigned char *p = detail::bytes_of(s.data());
+    std::size_t pos = 0;
+    while (pos < s.size()) {
+        std::size_t rest = s.size() - pos;
+        int piece = (rest < (1u << 30)) ? static_cast<int>(rest) : (1 << 30);
+        int valid = my_utf8_check_bytes(p + pos, piece);
+        if (valid == piece) {
+            pos += piece;
+        }
+        else if (static_cast<std::size_t>(piece) < rest && piece - valid < 4) {
+            pos += valid;
+        }
+        else {
+            return pos + (valid > 0 ? valid : 0);
+        }
+    }
+    return pos;
+}
+
+// Returns true if s is valid UTF-8.
+template <detail::byte_char CharT>
+constexpr bool check(std::basic_string_view<CharT> s) noexcept {
+    return valid_prefix(s) == s.size();
+}
+
+// Returns the number of characters in s, counting every byte that is not a
+// continuation byte like my_utf8_strlen_bytes.
+template <detail::byte_char CharT>
+constexpr std::size_t length(std::basic_string_view<CharT> s) noexcept {
+    if (std::is_constant_evaluated()) {
+        std::size_t count = 0;
+        for (CharT c : s) {
+            count += (detail::byte(c) & 0xC0) != 0x80;
+        }
+        return count;
+    }
+
+    // continuation bytes can be counted piece by piece
+    const unsigned char *p = detail::bytes_of(s.data());
+    std::size_t count = 0;
+    for (std::size_t pos = 0; pos < s.size(); pos += INT_MAX) {
+        std::size_t rest = s.size() - pos;
+        count += my_utf8_strlen_bytes(p + pos, (rest < INT_MAX) ? static_cast<int>(rest) : INT_MAX);
+    }
+    return count;
+}
+
+// overloads for strings, string literals and spans, so callers need no
+// conversions (the span overloads are templates so that a u8 literal, which
+// converts to both, picks the string view)
+constexpr decoded decode_next(std::string_view s) noexcept { return decode_next<char>(s); }
+constexpr decoded decode_next(std::u8string_view s) noexcept { return decode_next<char8_t>(s); }
+template <std::size_t Extent>
+constexpr decoded decode_next(std::span<const char8_t, Extent> s) noexcept {
+    return decode_next(std::u8string_view(s.data(), s.size()));
+}
+constexpr std::size_t valid_prefix(std::string_view s) noexcept { return valid_prefix<char>(s); }
+constexpr std::size_t valid_prefix(std::u8string_view s) noexcept { return valid_prefix<char8_t>(s); }
+template <std::size_t Extent>
+constexpr std::size_t valid_prefix(std::span<const char8_t, Extent> s) noexcept {
+    return valid_prefix(std::u8string_view(s.data(), s.size()));
+}
+constexpr bool check(std::string_view s) noexcept { return check<char>(s); }
+constexpr bool check(std::u8string_view s) noexcept { return check<char8_t>(s); }
+template <std::size_t Extent>
+constexpr bool check(std::span<const char8_t, Extent> s) noexcept {
+    return check(std::u8string_view(s.data(), s.size()));
+}
+constexpr std::size_t length(std::string_view s) noexcept { return length<char>(s); }
+constexpr std::size_t length(std::u8string_view s) noexcept { return length<char8_t>(s); }
+template <std::size_t Extent>
+constexpr std::size_t length(std::span<const char8_t, Extent> s) noexcept {
+    return length(std::u8string_view(s.data(), s.size()));
+}
+
+// Returns s unchanged, but fails to compile if s is not valid UTF-8 (throwing
+// in a consteval function is a compile error).
+consteval std::string_view checked(std::string_view s) {
+    if (!check(s)) {
+        throw "invalid UTF-8 in string literal";
+    }
+    return s;
+}
+consteval std::u8string_view checked(std::u8string_view s) {
+    if (!check(s)) {
+        throw "invalid UTF-8 in string literal";
+    }
+    return s;
+}
+
+// Forward range over the code points of a string. Every byte that is not part
+// of a valid character is returned as U+FFFD, like my_utf8_sanitize_bytes.
+template <detail::byte_char CharT>
+class code_point_view : public std::ranges::view_interface<code_point_view<CharT>> {
+public:
+    class iterator {
+    public:
+        using value_type = char32_t;
+        using difference_type = std::ptrdiff_t;
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag; // operator* returns a value
+
+        constexpr iterator() noexcept = default;
+        constexpr iterator(std::basic_string_view<CharT> text, std::size_t pos) noexcept
+            : text_(text), pos_(pos) {
+            load();
+        }
+
+        constexpr char32_t operator*() const noexcept { return current_.code_point; }
+        // byte offset of the current character in the string
+        constexpr std::size_t offset() const noexcept { return pos_; }
+        // bytes of the current character (1 for an invalid byte)
+        constexpr std::basic_string_view<CharT> bytes() const noexcept {
+            return text_.substr(pos_, current_.bytes);
+        }
+
+        constexpr iterator &operator++() noexcept {
+            pos_ += current_.bytes;
+            load();
+            return *this;
+        }
+        constexpr iterator operator++(int) noexcept {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        constexpr bool operator==(const iterator &other) const noexcept { return pos_ == other.pos_; }
+        constexpr bool operator==(std::default_sentinel_t) const noexcept { return pos_ >= text_.size(); }
+
+    private:
+        constexpr void load() noexcept {
+            if (pos_ >= text_.size()) {
+                current_ = {0, 0};
+                return;
+            }
+            current_ = decode_next(text_.substr(pos_));
+            if (current_.bytes <= 0) {
+                current_ = {replacement, 1};
+            }
+        }
+
+        std::basic_string_view<CharT> text_;
+        std::size_t pos_ = 0;
+        decoded current_{0, 0};
+    };
+
+    constexpr code_point_view() noexcept = default;
+    constexpr explicit code_point_view(std::basic_string_view<CharT> text) noexcept : text_(text) {}
+
+    constexpr iterator begin() const noexcept { return iterator(text_, 0); }
+    constexpr iterator end() const noexcept { return iterator(text_, text_.size()); }
+
+private:
+    std::basic_string_view<CharT> text_;
+};
+
+// Returns true for code points that attach to the character before them in
+// graphemes(): combining marks, joiners, variation selectors, emoji skin tone
+// modifiers and tag characters.
+constexpr bool extends_grapheme(char32_t c) noexcept {
+    return (c >= 0x0300 && c <= 0x036F) ||   // combining diacritical marks
+           (c >= 0x1AB0 && c <= 0x1AFF) ||   // combining marks extended
+           (c >= 0x1DC0 && c <= 0x1DFF) ||   // combining marks supplement
+           (c >= 0x20D0 && c <= 0x20FF) ||   // combining marks for symbols
+           (c >= 0xFE20 && c <= 0xFE2F) ||   // combining half marks
+           c == 0x200C || c == 0x200D ||     // zero width non-joiner, joiner
+           (c >= 0xFE00 && c <= 0xFE0F) ||   // variation selectors
+           (c >= 0xE0100 && c <= 0xE01EF) || // variation selectors supplement
+           (c >= 0x1F3FB && c <= 0x1F3FF) || // skin tone modifiers
+           (c >= 0xE0020 && c <= 0xE007F);   // tags (subdivision flags)
+}
+
+// Forward range over the user-perceived characters of a string, each returned
+// as a view of its bytes. This is an approximation of the Unicode rules: a
+// cluster is one code point followed by the code points that extend it (see
+// extends_grapheme), where a zero width joiner also pulls in the code point
+// after it. CR LF and pairs of regional indicators (flags) are kept together.
+template <detail::byte_char CharT>
+class grapheme_view : public std::ranges::view_interface<grapheme_view<CharT>> {
+public:
+    class iterator {
+    public:
+        using value_type = std::basic_string_view<CharT>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag; // operator* returns a value
+
+        constexpr iterator() noexcept = default;
+        constexpr iterator(std::basic_string_view<CharT> text, std::size_t pos) noexcept
+            : text_(text), pos_(pos) {
+            load();
+        }
+
+        constexpr value_type operator*() const noexcept { return text_.substr(pos_, size_); }
+        // byte offset of the current cluster in the string
+        constexpr std::size_t offset() const noexcept { return pos_; }
+
+        constexpr iterator &operator++() noexcept {
+            pos_ += size_;
+            load();
+            return *this;
+        }
+        constexpr iterator operator++(int) noexcept {
+            iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        constexpr bool operator==(const iterator &other) const noexcept { return pos_ == other.pos_; }
+        constexpr bool operator==(std::default_sentinel_t) const noexcept { return pos_ >= text_.size(); }
+
+    private:
+        static constexpr bool regional_indicator(char32_t c) noexcept {
+            return c >= 0x1F1E6 && c <= 0x1F1FF;
+        }
+
+        constexpr void load() noexcept {
+            size_ = 0;
+            if (pos_ >= text_.size()) {
+                return;
+            }
+            typename code_point_view<CharT>::iterator it(text_, pos_);
+            char32_t first = *it;
+            ++it;
+            if (it != std::default_sentinel) {
+                if ((first == U'\r' && *it == U'\n') || (regional_indicator(first) && regional_indicator(*it))) {
+                    ++it;
+                }
+            }
+            char32_t last = first;
+            while (it != std::default_sentinel && (extends_grapheme(*it) || last == 0x200D)) {
+                last = *it;
+                ++it;
+            }
+            size_ = it.offset() - pos_;
+        }
+
+        std::basic_string_view<CharT> text_;
+        std::size_t pos_ = 0;
+        std::size_t size_ = 0;
+    };
+
+    constexpr grapheme_view() noexcept = default;
+    constexpr explicit grapheme_view(std::basic_string_view<CharT> text) noexcept : text_(text) {}
+
+    constexpr iterator begin() const noexcept { return iterator(text_, 0); }
+    constexpr iterator end() const noexcept { return iterator(text_, text_.size()); }
+
+private:
+    std::basic_string_view<CharT> text_;
+};
+
+constexpr code_point_view<char> code_points(std::string_view s) noexcept { return code_point_view<char>(s); }
+constexpr code_point_view<char8_t> code_points(std::u8string_view s) noexcept {
+    return code_point_view<char8_t>(s);
+}
+template <std::size_t Extent>
+constexpr code_point_view<char8_t> code_points(std::span<const char8_t, Extent> s) noexcept {
+    return code_point_view<char8_t>(std::u8string_view(s.data(), s.size()));
+}
+constexpr grapheme_view<char> graphemes(std::string_view s) noexcept { return grapheme_view<char>(s); }
+constexpr grapheme_view<char8_t> graphemes(std::u8string_view s) noexcept {
+    return grapheme_view<char8_t>(s);
+}
+template <std::size_t Extent>
+constexpr grapheme_view<char8_t> graphemes(std::span<const char8_t, Extent> s) noexcept {
+    return grapheme_view<char8_t>(std::u8string_view(s.data(), s.size()));
+}
+
+static_assert(std::ranges::forward_range<code_point_view<char>>);
+static_assert(std::ranges::view<grapheme_view<char8_t>>);
+
+} // namespace my_utf8
+
+// the views only point into the string, so their iterators outlive them
+namespace std::ranges {
+template <class CharT>
+inline constexpr bool enable_borrowed_range<my_utf8::code_point_view<CharT>> = true;
+template <class CharT>
+inline constexpr bool enable_borrowed_range<my_utf8::grapheme_view<CharT>> = true;
+} // namespace std::ranges
+
+#endif // MY_UTF8_HPP
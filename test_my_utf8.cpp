@@ -0,0 +1,228 @@
+// test_my_utf8.cpp - tests for the C++ layer in my_utf8.hpp
+//
+// Build: cc -O2 -c -DMY_UTF8_NO_TESTS my_utf8.c -o my_utf8.o
+//        c++ -std=c++20 -O2 -o test_my_utf8 test_my_utf8.cpp my_utf8.o
+//
+// The static_asserts run the constexpr code paths at compile time; the test
+// functions run the same inputs through the run-time paths (the kernels in
+// my_utf8.c) and print PASSED or FAILED. The exit status is 1 if any failed.
+// Define MY_UTF8_SHOW_CHECKED_ERROR to see the compile error of checked().
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <algorithm>
+#include <ranges>
+
+#include "my_utf8.hpp"
+
+using namespace std::literals;
+
+// compile-time results of the constexpr paths
+static_assert(my_utf8::check(""sv));
+static_assert(my_utf8::check("h\xc3\xa9llo \xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x98\x80"sv));
+static_assert(my_utf8::check(u8"héllo 你好 😀"));
+static_assert(!my_utf8::check("\xc0\x80"sv));         // overlong
+static_assert(!my_utf8::check("\xed\xa0\x80"sv));     // surrogate
+static_assert(!my_utf8::check("\xf4\x90\x80\x80"sv)); // above U+10FFFF
+static_assert(!my_utf8::check("ab\xe4\xbd"sv));       // cut off at the end
+static_assert(my_utf8::valid_prefix("ab\xe4\xbd"sv) == 2);
+static_assert(my_utf8::valid_prefix("\xc3\xa9\xff\xc3\xa9"sv) == 2);
+static_assert(my_utf8::length(u8"héllo 你好 😀") == 10);
+static_assert(my_utf8::length("a\xff\x80"sv) == 2); // continuation bytes are not counted
+static_assert(my_utf8::decode_next(u8"é!").code_point == 0xE9 && my_utf8::decode_next(u8"é!").bytes == 2);
+static_assert(my_utf8::decode_next("\xf0\x9f\x98"sv).bytes == 0);  // cut off, valid so far
+static_assert(my_utf8::decode_next("\xe0\x80"sv).bytes == -1);     // overlong even when cut off
+static_assert(my_utf8::decode_next(""sv).bytes == 0);
+static_assert(my_utf8::decode_n<3>("\xe2\x82\xac").code_point == 0x20AC);
+static_assert(my_utf8::decode_n<2>("\xe2\x82").bytes == -1); // wrong length for the first byte
+static_assert(my_utf8::decode_n<4>("\xf4\x8f\xbf\xbf").code_point == 0x10FFFF);
+static_assert(my_utf8::checked("h\xc3\xa9llo") == "h\xc3\xa9llo");
+static_assert(std::ranges::distance(my_utf8::code_points(u8"a😀\xff")) == 3);
+static_assert(std::ranges::distance(my_utf8::graphemes(u8"é\r\n🇺🇸")) == 3);
+
+// literal that can be a template argument, to try checked() on it in a concept
+template <std::size_t N>
+struct literal {
+    char bytes[N];
+    constexpr literal(const char (&s)[N]) {
+        std::copy(s, s + N, bytes);
+    }
+};
+
+// true if my_utf8::checked(S) compiles
+template <literal S>
+concept accepted = requires {
+    typename std::integral_constant<std::size_t,
+        my_utf8::checked(std::string_view(S.bytes, sizeof(S.bytes) - 1)).size()>;
+};
+
+static_assert(accepted<"h\xc3\xa9llo">);
+static_assert(!accepted<"h\xe9llo">);      // Latin-1, not UTF-8
+static_assert(!accepted<"\xed\xa0\x80">);  // surrogate
+static_assert(!accepted<"ab\xf0\x9f\x98">); // cut off
+
+#ifdef MY_UTF8_SHOW_CHECKED_ERROR
+constexpr auto bad = my_utf8::checked("h\xe9llo"); // error: invalid UTF-8 in string literal
+#endif
+
+int failures = 0;
+
+void report(bool ok, const char *what, std::string_view input, long long expected, long long result) {
+    std::printf("%s: %s, Input=\"%.*s\", Expected=%lld, Result=%lld\n", ok ? "PASSED" : "FAILED", what,
+                static_cast<int>(std::min<std::size_t>(input.size(), 40)), input.data(), expected, result);
+    failures += !ok;
+}
+
+// runs check, valid_prefix and length at run time (a std::string is never a
+// constant expression) and compares them with the C functions
+void test_hpp_runtime(std::string input, long long expectedPrefix, long long expectedLength) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input.data());
+    long long prefix = static_cast<long long>(my_utf8::valid_prefix(std::string_view(input)));
+    long long length = static_cast<long long>(my_utf8::length(std::string_view(input)));
+    bool valid = my_utf8::check(std::string_view(input));
+
+    report(prefix == expectedPrefix && prefix == my_utf8_check_bytes(bytes, static_cast<int>(input.size())),
+           "valid_prefix", input, expectedPrefix, prefix);
+    report(valid == (expectedPrefix == static_cast<long long>(input.size())), "check", input,
+           expectedPrefix == static_cast<long long>(input.size()), valid);
+    report(length == expectedLength && length == my_utf8_strlen_bytes(bytes, static_cast<int>(input.size())),
+           "length", input, expectedLength, length);
+}
+
+void test_all_hpp_runtime() {
+    std::printf("\nTesting check, valid_prefix and length at run time:\n");
+    test_hpp_runtime("", 0, 0);
+    test_hpp_runtime("Hello, world", 12, 12);
+    test_hpp_runtime("h\xc3\xa9llo \xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x98\x80", 18, 10);
+    test_hpp_runtime("long ASCII run before the character \xc3\xa9 and after it", 51, 50);
+    test_hpp_runtime("\xc0\x80", 0, 1);
+    test_hpp_runtime("abc\xed\xa0\x80", 3, 4);
+    test_hpp_runtime("abc\xf4\x90\x80\x80", 3, 4);
+    test_hpp_runtime("ab\xe4\xbd", 2, 3);
+    test_hpp_runtime(std::string("a\0b", 3), 3, 3);
+
+    // the span and u8 overloads give the same answers
+    std::u8string text = u8"héllo 😀";
+    std::span<const char8_t> span(text.data(), text.size());
+    report(my_utf8::check(span) && my_utf8::length(span) == 7, "span overloads", "h\xc3\xa9llo \xf0\x9f\x98\x80",
+           7, static_cast<long long>(my_utf8::length(span)));
+}
+
+// compares decode_next (and so decode_n) with my_utf8_decode_next for a
+// sequence and all of its prefixes
+bool same_as_c(const unsigned char *bytes, int len) {
+    for (int n = 0; n <= len; ++n) {
+        int codePoint = 0;
+        int expected = my_utf8_decode_next(bytes, n, &codePoint);
+        my_utf8::decoded got = my_utf8::decode_next(std::string_view(reinterpret_cast<const char *>(bytes), n));
+        if (got.bytes != expected || (expected > 0 && got.code_point != static_cast<char32_t>(codePoint))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_all_hpp_decode_next() {
+    std::printf("\nTesting decode_next against my_utf8_decode_next:\n");
+    // every first byte with every second and third byte, and the fourth
+    // byte at the edges of the continuation range
+    long long checked = 0;
+    long long different = 0;
+    unsigned char bytes[4];
+    for (int a = 0; a < 256; ++a) {
+        for (int b = 0; b < 256; ++b) {
+            for (int c = (a >= 0xE0) ? 0 : 0x80; c < ((a >= 0xE0) ? 256 : 0x81); ++c) {
+                for (int d : {0x41, 0x80, 0xBF, 0xC0}) {
+                    bytes[0] = static_cast<unsigned char>(a);
+                    bytes[1] = static_cast<unsigned char>(b);
+                    bytes[2] = static_cast<unsigned char>(c);
+                    bytes[3] = static_cast<unsigned char>(d);
+                    different += !same_as_c(bytes, 4);
+                    checked++;
+                }
+            }
+        }
+    }
+    report(different == 0, "sequences decoded differently", "", 0, different);
+    report(checked == 4 * (32 * 256 * 256 + 224 * 256), "sequences tried", "", 4 * (32 * 256 * 256 + 224 * 256),
+           checked);
+}
+
+// valid_prefix and length call the C functions 1 GiB at a time (they take an
+// int length); a character cut by that boundary must still be read whole
+void test_all_hpp_piece_boundary() {
+    std::printf("\nTesting valid_prefix and length at the 1 GiB piece boundary:\n");
+    const std::size_t boundary = std::size_t(1) << 30;
+    const std::size_t size = boundary + 8;
+    // calloc of this size maps zero pages, so only the pages written are used
+    char *data = static_cast<char *>(std::calloc(size, 1));
+    if (data == nullptr) {
+        std::printf("SKIPPED: could not allocate %zu bytes\n", size);
+        return;
+    }
+    std::string_view text(data, size);
+    std::string_view tail("...");
+
+    std::memcpy(data + boundary - 2, "\xf0\x9f\x98\x80", 4); // 4-byte character across the boundary
+    report(my_utf8::valid_prefix(text) == size, "valid_prefix with a character across the boundary", tail,
+           static_cast<long long>(size), static_cast<long long>(my_utf8::valid_prefix(text)));
+    report(my_utf8::length(text) == size - 3, "length with a character across the boundary", tail,
+           static_cast<long long>(size - 3), static_cast<long long>(my_utf8::length(text)));
+
+    data[boundary + 1] = 'a'; // now cut off after 3 of its 4 bytes
+    report(my_utf8::valid_prefix(text) == boundary - 2, "valid_prefix with a cut character across the boundary",
+           tail, static_cast<long long>(boundary - 2), static_cast<long long>(my_utf8::valid_prefix(text)));
+
+    std::memset(data + boundary - 2, 0, 4);
+    data[boundary - 1] = '\xff'; // invalid byte just before the boundary
+    report(my_utf8::valid_prefix(text) == boundary - 1, "valid_prefix with an invalid byte before the boundary",
+           tail, static_cast<long long>(boundary - 1), static_cast<long long>(my_utf8::valid_prefix(text)));
+
+    data[boundary - 1] = 0;
+    data[boundary + 2] = '\x80'; // invalid byte just after it
+    report(my_utf8::valid_prefix(text) == boundary + 2, "valid_prefix with an invalid byte after the boundary",
+           tail, static_cast<long long>(boundary + 2), static_cast<long long>(my_utf8::valid_prefix(text)));
+    std::free(data);
+}
+
+// splits input with graphemes() and compares the clusters, joined with |
+void test_hpp_graphemes(std::string_view input, std::string_view expected) {
+    std::string result;
+    for (std::string_view cluster : my_utf8::graphemes(input)) {
+        result += result.empty() ? "" : "|";
+        result += cluster;
+    }
+    bool ok = (result == expected);
+    std::printf("%s: Input=\"%.*s\", Expected=\"%.*s\", Result=\"%s\"\n", ok ? "PASSED" : "FAILED",
+                static_cast<int>(input.size()), input.data(), static_cast<int>(expected.size()), expected.data(),
+                result.c_str());
+    failures += !ok;
+}
+
+void test_all_hpp_graphemes() {
+    std::printf("\nTesting graphemes:\n");
+    test_hpp_graphemes("", "");
+    test_hpp_graphemes("abc", "a|b|c");
+    test_hpp_graphemes("a\r\nb", "a|\r\n|b");
+    test_hpp_graphemes("\r\r\n\n", "\r|\r\n|\n");
+    test_hpp_graphemes("e\xcc\x81x", "e\xcc\x81|x"); // e and a combining acute accent
+    // man, ZWJ, woman, ZWJ, girl
+    test_hpp_graphemes("\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7!",
+                       "\xf0\x9f\x91\xa8\xe2\x80\x8d\xf0\x9f\x91\xa9\xe2\x80\x8d\xf0\x9f\x91\xa7|!");
+    test_hpp_graphemes("\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd", "\xf0\x9f\x91\x8d\xf0\x9f\x8f\xbd"); // skin tone
+    // two flags, then a lone regional indicator
+    test_hpp_graphemes("\xf0\x9f\x87\xba\xf0\x9f\x87\xb8\xf0\x9f\x87\xab\xf0\x9f\x87\xb7\xf0\x9f\x87\xba",
+                       "\xf0\x9f\x87\xba\xf0\x9f\x87\xb8|\xf0\x9f\x87\xab\xf0\x9f\x87\xb7|\xf0\x9f\x87\xba");
+    test_hpp_graphemes("a\xffz", "a|\xff|z"); // an invalid byte is a cluster of its own
+}
+
+int main() {
+    test_all_hpp_runtime();
+    test_all_hpp_decode_next();
+    test_all_hpp_piece_boundary();
+    test_all_hpp_graphemes();
+    return failures ? 1 : 0;
+}
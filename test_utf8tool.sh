@@ -0,0 +1,147 @@
+#!/bin/sh
+# test_utf8tool.sh - tests for utf8tool
+#
+# usage: sh test_utf8tool.sh
+#
+# Builds utf8tool in a temporary directory and runs it on generated files,
+# both memory-mapped (file argument) and streamed (through a pipe). Prints a
+# PASSED or FAILED line per test; the exit status is 1 if any test failed.
+
+cd "$(dirname "$0")" || exit 1
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+cc -O2 -pthread -DMY_UTF8_NO_TESTS -o "$dir/utf8tool" utf8tool.c my_utf8.c || exit 1
+tool="$dir/utf8tool"
+failed=0
+
+# expect NAME EXPECTED ACTUAL
+expect() {
+    if [ "$2" = "$3" ]; then
+        printf '%s\n' "PASSED: $1, Expected=\"$2\", Result=\"$3\""
+    else
+        printf '%s\n' "FAILED: $1, Expected=\"$2\", Result=\"$3\""
+        failed=1
+    fi
+}
+
+# same NAME FILE1 FILE2: the two files have the same bytes
+same() {
+    if cmp -s "$2" "$3"; then
+        printf '%s\n' "PASSED: $1"
+    else
+        printf '%s\n' "FAILED: $1 ($2 and $3 differ)"
+        failed=1
+    fi
+}
+
+# repeat COUNT CHAR: COUNT copies of an ASCII character
+repeat() {
+    head -c "$1" /dev/zero | tr '\0' "$2"
+}
+
+# mixed text with invalid bytes, a little over two 4 MiB blocks
+printf 'caf\303\251 \316\261\316\262\316\263 \344\275\240\345\245\275 \360\237\230\200 \\u0041\n' > "$dir/line"
+for k in $(seq 200); do cat "$dir/line"; done > "$dir/page"
+for k in $(seq 200); do cat "$dir/page"; done > "$dir/mixed"
+printf 'bad \377 \300\257 \355\240\200 end\n' >> "$dir/mixed"
+cat "$dir/mixed" "$dir/mixed" > "$dir/mixed2"
+
+# memory-mapped and streamed input give the same result
+for command in check strlen sanitize; do
+    "$tool" -q $command "$dir/mixed2" > "$dir/mapped.$command"
+    cat "$dir/mixed2" | "$tool" -q $command > "$dir/stream.$command"
+    same "mapped and streamed $command" "$dir/mapped.$command" "$dir/stream.$command"
+done
+"$tool" -q sanitize "$dir/mixed2" > "$dir/clean"
+"$tool" -q escape "$dir/clean" > "$dir/mapped.escape"
+cat "$dir/clean" | "$tool" -q escape > "$dir/stream.escape"
+same "mapped and streamed escape" "$dir/mapped.escape" "$dir/stream.escape"
+"$tool" -q unescape "$dir/mapped.escape" > "$dir/mapped.unescape"
+cat "$dir/mapped.escape" | "$tool" -q unescape > "$dir/stream.unescape"
+same "mapped and streamed unescape" "$dir/mapped.unescape" "$dir/stream.unescape"
+same "escape and unescape of two blocks" "$dir/clean" "$dir/mapped.unescape"
+
+# stdin that was partly read already is mapped from where it was left
+printf '\377\377\377\377\377\377\377\377\377\377ok \303\251' > "$dir/skip"
+expect "check of stdin after 10 bytes were read" "valid" \
+    "$( (head -c 10 > /dev/null; "$tool" -q check) < "$dir/skip")"
+expect "strlen of stdin after 10 bytes were read, then again" "4 0" \
+    "$( (head -c 10 > /dev/null; "$tool" -q strlen; "$tool" -q strlen) < "$dir/skip" | tr '\n' ' ' | sed 's/ $//')"
+( dd bs=5000 count=1 of=/dev/null 2> /dev/null; "$tool" -q sanitize ) < "$dir/mixed2" > "$dir/mapped.skip"
+tail -c +5001 "$dir/mixed2" | "$tool" -q sanitize > "$dir/stream.skip"
+same "sanitize of stdin from an offset inside a page" "$dir/stream.skip" "$dir/mapped.skip"
+
+# characters and escapes cut off by the 4 MiB block boundary
+{ repeat 4194302 a; printf '\360\237\230\200b'; } > "$dir/straddle4"
+{ repeat 4194303 a; printf '\344\275\240b'; } > "$dir/straddle3"
+for file in straddle4 straddle3; do
+    expect "check of $file (mapped)" "valid" "$("$tool" -q check "$dir/$file")"
+    expect "check of $file (stream)" "valid" "$(cat "$dir/$file" | "$tool" -q check)"
+    expect "strlen of $file (stream)" "$("$tool" -q strlen "$dir/$file")" \
+        "$(cat "$dir/$file" | "$tool" -q strlen)"
+    cat "$dir/$file" | "$tool" -q escape | "$tool" -q unescape > "$dir/$file.back"
+    same "escape and unescape of $file (stream)" "$dir/$file" "$dir/$file.back"
+done
+expect "strlen of straddle4" "4194304" "$("$tool" -q strlen "$dir/straddle4")"
+expect "escape of straddle4" '\u1F600b' "$(cat "$dir/straddle4" | "$tool" -q escape | tail -c 8)"
+for cut in 1 3 6 7; do
+    { repeat $((4194304 - cut)) a; printf '\\U10FFFF!'; } > "$dir/escape$cut"
+    expect "unescape of an escape cut $cut bytes in" "$(printf '\364\217\277\277!')" \
+        "$(cat "$dir/escape$cut" | "$tool" -q unescape | tail -c 5)"
+done
+
+# the first bad byte is found at the same offset with any number of threads
+{ repeat 17000001 a; printf '\200'; repeat 3000000 a; printf '\377'; } > "$dir/late"
+for threads in 1 2 4 7; do
+    expect "check -j$threads error offset" "invalid: invalid UTF-8 at byte 17000001" \
+        "$("$tool" -q -j$threads check "$dir/late")"
+done
+expect "check error offset (stream)" "invalid: invalid UTF-8 at byte 17000001" \
+    "$(cat "$dir/late" | "$tool" -q check)"
+{ repeat 16777215 a; printf '\342\202\254'; repeat 1000 a; printf '\342\202'; } > "$dir/cut"
+expect "check -j4 error offset at a cut character" "invalid: invalid UTF-8 at byte 16778218" \
+    "$("$tool" -q -j4 check "$dir/cut")"
+expect "strlen -j4 of a file split between threads" "$("$tool" -q -j1 strlen "$dir/cut")" \
+    "$("$tool" -q -j4 strlen "$dir/cut")"
+
+# transcode to every encoding and back
+"$tool" -q sanitize "$dir/page" > "$dir/text"
+for encoding in utf-8 utf-16le utf-16be utf-32le utf-32be; do
+    "$tool" -q transcode utf-8 $encoding "$dir/text" > "$dir/text.$encoding"
+    "$tool" -q transcode $encoding utf-8 "$dir/text.$encoding" > "$dir/back.$encoding"
+    same "transcode utf-8 to $encoding and back (mapped)" "$dir/text" "$dir/back.$encoding"
+    cat "$dir/text" | "$tool" -q transcode utf-8 $encoding |
+        "$tool" -q transcode $encoding utf-8 > "$dir/back.$encoding"
+    same "transcode utf-8 to $encoding and back (stream)" "$dir/text" "$dir/back.$encoding"
+done
+printf 'caf\351 \327\377\n' > "$dir/latin"
+"$tool" -q transcode latin1 utf-8 "$dir/latin" | "$tool" -q transcode utf-8 latin1 > "$dir/back.latin1"
+same "transcode latin1 to utf-8 and back" "$dir/latin" "$dir/back.latin1"
+expect "transcode utf-16le of a lone surrogate" "1" \
+    "$(printf '\000\334' | "$tool" -q transcode utf-16le utf-8 > /dev/null 2>&1; echo $?)"
+
+# escape and unescape give back the input
+n=0
+for text in 'a\000b' 'back\\slash' '\\u0041 \\U10FFFF \\u' '\303\251c \303\251E \303\2510' \
+        '\364\217\277\277 \363\260\200\200 \360\237\230\200f' '\000\000\303\251\000'; do
+    n=$((n + 1))
+    printf "$text" > "$dir/text$n"
+    "$tool" -q escape "$dir/text$n" | "$tool" -q unescape > "$dir/back$n"
+    same "escape and unescape of \"$text\"" "$dir/text$n" "$dir/back$n"
+done
+expect "escape of null, backslash and U+00E9" 'a\u00000\u0005C\u000E9c' \
+    "$(printf 'a\000\\\303\251c' | "$tool" -q escape)"
+expect "escape of U+10FFFF" '\U10FFFF' "$(printf '\364\217\277\277' | "$tool" -q escape)"
+expect "unescape of my_utf8_encode escapes" "$(printf '\303\251 A\360\237\230\200')" \
+    "$(printf '\\uE9 \\u41\\u1F600' | "$tool" -q unescape)"
+printf 'x\\u0000 tail' | "$tool" -q unescape > "$dir/null"
+printf 'x\000 tail' > "$dir/null.expected"
+same "unescape of \\u0000 keeps the rest" "$dir/null.expected" "$dir/null"
+expect "unescape of a surrogate" "1" \
+    "$(printf 'ok \\uD800' | "$tool" -q unescape > /dev/null 2>&1; echo $?)"
+expect "unescape of a value above U+10FFFF" "1" \
+    "$(printf '\\U110000' | "$tool" -q unescape > /dev/null 2>&1; echo $?)"
+expect "escape of invalid UTF-8" "1" \
+    "$(printf 'a\300\257' | "$tool" -q escape > /dev/null 2>&1; echo $?)"
+
+exit $failed
@@ -0,0 +1,784 @@
+// utf8tool - validate, count, sanitize, escape and transcode UTF-8 files
+//
+// Build: cc -O2 -pthread -DMY_UTF8_NO_TESTS -o utf8tool utf8tool.c my_utf8.c
+// Tests: sh test_utf8tool.sh
+//
+// usage: utf8tool [-j threads] [-q] command [file]
+//   check              validate the input (exit status 1 if it is invalid)
+//   strlen             count the characters in the input
+//   sanitize           replace invalid bytes with U+FFFD
+//   escape             write non-ASCII characters as \uXXXXX
+//   unescape           turn \uXXXXX sequences back into UTF-8
+//   transcode FROM TO  convert between utf-8, utf-16le, utf-16be, utf-32le,
+//                      utf-32be and latin1
+//
+// escape writes non-ASCII characters, null bytes and backslashes as \u and
+// 5 hex digits (\U and 6 above U+FFFFF), so unescape gives back exactly the
+// input. unescape also reads the shorter \u escapes of my_utf8_encode.
+//
+// Regular files (and stdin redirected from a file, from its current offset)
+// are memory-mapped; pipes are read by a second thread into two buffers that
+// take turns. check and strlen split large mapped files between threads. The
+// throughput is written to stderr unless -q is given.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "my_utf8.h"
+
+#define BLOCK_SIZE (1 << 22)     // bytes handed to a command at a time
+#define CARRY_ROOM 16            // room for a character cut off between blocks
+#define PARALLEL_MIN (1 << 24)   // smallest mapped file split between threads
+
+// commands
+enum { CMD_CHECK, CMD_STRLEN, CMD_SANITIZE, CMD_ESCAPE, CMD_UNESCAPE, CMD_TRANSCODE };
+
+// encodings for transcode
+enum { ENC_UTF8, ENC_UTF16LE, ENC_UTF16BE, ENC_UTF32LE, ENC_UTF32BE, ENC_LATIN1 };
+
+// state of the running command
+typedef struct {
+    int command;
+    int from;                  // input encoding (transcode)
+    int to;                    // output encoding (transcode)
+    unsigned long long offset; // input bytes consumed so far
+    unsigned long long count;  // characters counted (strlen)
+    long long errorAt;         // offset of the first bad input byte, or -1
+    const char *error;         // what was wrong with it
+    unsigned char *out;        // output buffer
+    size_t outSize;
+} toolState;
+
+// helper function to make sure a buffer holds at least size bytes
+int reserve(unsigned char **buffer, size_t *capacity, size_t size) {
+    if (size <= *capacity) {
+        return 0;
+    }
+    unsigned char *grown = (unsigned char*)realloc(*buffer, size);
+    if (grown == NULL) {
+        return -1;
+    }
+    *buffer = grown;
+    *capacity = size;
+    return 0;
+}
+
+// helper function to find how many bytes of a block end on a character
+// boundary, so that a character cut off at the end waits for the next block
+size_t completeLength(const unsigned char *data, size_t len) {
+    // look back at most 3 bytes for the first byte of the last character
+    for (size_t back = 1; back <= 3 && back <= len; ++back) {
+        unsigned char c = data[len - back];
+        if ((c & 0xC0) == 0x80) {
+            continue; // continuation byte, keep looking
+        }
+        size_t need = (c >= 0xF0) ? 4 : (c >= 0xE0) ? 3 : (c >= 0xC0) ? 2 : 1;
+        return (need > back) ? len - back : len;
+    }
+    return len;
+}
+
+// helper function to record the first bad byte of the input
+void fail(toolState *t, unsigned long long at, const char *why) {
+    if (t->errorAt < 0) {
+        t->errorAt = (long long)at;
+        t->error = why;
+    }
+}
+
+// helper function to decode one character in encoding enc into *codePoint.
+// Returns the number of bytes used, 0 if the character is cut off at len, or
+// -1 if the bytes are invalid.
+int decodeChar(int enc, const unsigned char *p, size_t len, int *codePoint) {
+    switch (enc) {
+    case ENC_UTF8:
+        return my_utf8_decode_next(p, (len > 4) ? 4 : (int)len, codePoint);
+    case ENC_LATIN1:
+        *codePoint = p[0];
+        return 1;
+    case ENC_UTF16LE:
+    case ENC_UTF16BE: {
+        if (len < 2) {
+            return 0;
+        }
+        int big = (enc == ENC_UTF16BE);
+        int unit = big ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+        if (unit >= 0xDC00 && unit <= 0xDFFF) {
+            return -1; // low surrogate without a high one
+        }
+        if (unit < 0xD800 || unit > 0xDBFF) {
+            *codePoint = unit;
+            return 2;
+        }
+        if (len < 4) {
+            return 0;
+        }
+        int low = big ? (p[2] << 8 | p[3]) : (p[3] << 8 | p[2]);
+        if (low < 0xDC00 || low > 0xDFFF) {
+            return -1; // high surrogate without a low one
+        }
+        *codePoint = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+        return 4;
+    }
+    case ENC_UTF32LE:
+    case ENC_UTF32BE: {
+        if (len < 4) {
+            return 0;
+        }
+        uint32_t value = (enc == ENC_UTF32BE)
+            ? ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3])
+            : ((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0]);
+        if (value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+            return -1;
+        }
+        *codePoint = (int)value;
+        return 4;
+    }
+    }
+    return -1;
+}
+
+// helper function to encode a code point in encoding enc. Returns the number
+// of bytes written, or -1 if the encoding cannot represent the code point.
+int encodeChar(int enc, int codePoint, unsigned char *out) {
+    switch (enc) {
+    case ENC_UTF8:
+        if (codePoint <= 0x7F) {
+            out[0] = (unsigned char)codePoint;
+            return 1;
+        }
+        if (codePoint <= 0x7FF) {
+            out[0] = (unsigned char)(0xC0 | (codePoint >> 6));
+            out[1] = (unsigned char)(0x80 | (codePoint & 0x3F));
+            return 2;
+        }
+        if (codePoint <= 0xFFFF) {
+            out[0] = (unsigned char)(0xE0 | (codePoint >> 12));
+            out[1] = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+            out[2] = (unsigned char)(0x80 | (codePoint & 0x3F));
+            return 3;
+        }
+        out[0] = (unsigned char)(0xF0 | (codePoint >> 18));
+        out[1] = (unsigned char)(0x80 | ((codePoint >> 12) & 0x3F));
+        out[2] = (unsigned char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out[3] = (unsigned char)(0x80 | (codePoint & 0x3F));
+        return 4;
+    case ENC_LATIN1:
+        if (codePoint > 0xFF) {
+            return -1;
+        }
+        out[0] = (unsigned char)codePoint;
+        return 1;
+    case ENC_UTF16LE:
+    case ENC_UTF16BE: {
+        int units[2];
+        int count = 1;
+        units[0] = codePoint;
+        if (codePoint >= 0x10000) { // surrogate pair
+            units[0] = 0xD800 + ((codePoint - 0x10000) >> 10);
+            units[1] = 0xDC00 + ((codePoint - 0x10000) & 0x3FF);
+            count = 2;
+        }
+        for (int k = 0; k < count; ++k) {
+            unsigned char high = (unsigned char)(units[k] >> 8);
+            unsigned char low = (unsigned char)(units[k] & 0xFF);
+            out[2 * k] = (enc == ENC_UTF16BE) ? high : low;
+            out[2 * k + 1] = (enc == ENC_UTF16BE) ? low : high;
+        }
+        return 2 * count;
+    }
+    case ENC_UTF32LE:
+    case ENC_UTF32BE:
+        for (int k = 0; k < 4; ++k) {
+            unsigned char byte = (unsigned char)(codePoint >> (8 * k));
+            out[(enc == ENC_UTF32BE) ? 3 - k : k] = byte;
+        }
+        return 4;
+    }
+    return -1;
+}
+
+// helper function to write a block of valid UTF-8 with every non-ASCII
+// character, null byte and backslash escaped. Escapes always have a fixed
+// number of hex digits, \u and 5 digits up to U+FFFFF and \U and 6 digits
+// above, so a digit after an escape is never read as part of it.
+int escapeBlock(toolState *t, const unsigned char *data, size_t len, FILE *output) {
+    // an escape is at most 8 bytes for a character of at least 1 byte
+    if (reserve(&t->out, &t->outSize, 8 * len + 1) != 0) {
+        return -1;
+    }
+    size_t out = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        int codePoint;
+        int bytes = my_utf8_decode_next(data + i, (int)(len - i), &codePoint);
+        if (bytes <= 0) {
+            fail(t, t->offset + i, "invalid UTF-8");
+            return -1;
+        }
+        if (codePoint >= 0x80 || codePoint == '\0' || codePoint == '\\') {
+            // snprintf needs room for its null byte, which the next escape overwrites
+            const char *format = (codePoint > 0xFFFFF) ? "\\U%06X" : "\\u%05X";
+            out += (size_t)snprintf((char *)t->out + out, 9, format, codePoint);
+        }
+        else {
+            t->out[out++] = (unsigned char)codePoint;
+        }
+        i += bytes;
+    }
+    fwrite(t->out, 1, out, output);
+    return 0;
+}
+
+// helper function to read up to max hex digits. Returns how many were read.
+int readHex(const unsigned char *p, size_t len, int max, int *value) {
+    int digits = 0;
+    *value = 0;
+    while (digits < max && (size_t)digits < len) {
+        unsigned char c = p[digits];
+        int d = (c >= '0' && c <= '9') ? c - '0' :
+                (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (d < 0) {
+            break;
+        }
+        *value = (*value << 4) | d;
+        digits++;
+    }
+    return digits;
+}
+
+// helper function to turn the escapes of a block back into UTF-8. \u takes 1
+// to 5 hex digits (as my_utf8_encode reads them) and \U exactly 6; anything
+// else, null bytes included, is copied as it is. Escapes of surrogates or of
+// values above U+10FFFF are errors.
+int unescapeBlock(toolState *t, const unsigned char *data, size_t len, FILE *output) {
+    // no escape writes more bytes than it reads
+    if (reserve(&t->out, &t->outSize, len + 1) != 0) {
+        return -1;
+    }
+    size_t out = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        int codePoint;
+        int digits = 0;
+        if (data[i] == '\\' && i + 1 < len && data[i + 1] == 'u') {
+            digits = readHex(data + i + 2, len - i - 2, 5, &codePoint);
+        }
+        else if (data[i] == '\\' && i + 1 < len && data[i + 1] == 'U' &&
+                 readHex(data + i + 2, len - i - 2, 6, &codePoint) == 6) {
+            digits = 6;
+        }
+        if (digits == 0) {
+            t->out[out++] = data[i++];
+            continue;
+        }
+        if (codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+            fail(t, t->offset + i, "invalid escape");
+            return -1;
+        }
+        out += (size_t)encodeChar(ENC_UTF8, codePoint, t->out + out);
+        i += 2 + (size_t)digits;
+    }
+    fwrite(t->out, 1, out, output);
+    return 0;
+}
+
+// helper function to run the command over one block of input. The block may
+// end in the middle of a character unless final is set. Returns the number of
+// bytes used (the rest is passed again at the start of the next block), or -1
+// to stop.
+long processBlock(toolState *t, const unsigned char *data, size_t len, int final, FILE *output) {
+    size_t use = final ? len : completeLength(data, len);
+
+    switch (t->command) {
+    case CMD_CHECK: {
+        int valid = my_utf8_check_bytes(data, (int)use);
+        if ((size_t)valid < use) {
+            fail(t, t->offset + valid, "invalid UTF-8");
+            return -1;
+        }
+        return (long)use;
+    }
+    case CMD_STRLEN:
+        // counting first bytes of characters works across block boundaries
+        t->count += my_utf8_strlen_bytes(data, (int)len);
+        return (long)len;
+    case CMD_SANITIZE: {
+        if (reserve(&t->out, &t->outSize, 3 * use) != 0) {
+            return -1;
+        }
+        int written = my_utf8_sanitize_bytes(data, (int)use, t->out);
+        fwrite(t->out, 1, written, output);
+        return (long)use;
+    }
+    case CMD_ESCAPE:
+        return (escapeBlock(t, data, use, output) == 0) ? (long)use : -1;
+    case CMD_UNESCAPE: {
+        // an escape is at most 8 bytes ("\U" and 6 hex digits), so hold back
+        // a backslash near the end until the next block is here
+        use = len;
+        for (size_t back = 1; !final && back <= 7 && back <= len; ++back) {
+            if (data[len - back] == '\\') {
+                use = len - back;
+            }
+        }
+        return (unescapeBlock(t, data, use, output) == 0) ? (long)use : -1;
+    }
+    case CMD_TRANSCODE: {
+        // no encoding needs more than 4 output bytes per input byte
+        if (reserve(&t->out, &t->outSize, 4 * len + 4) != 0) {
+            return -1;
+        }
+        size_t pos = 0;
+        size_t written = 0;
+        while (pos < len) {
+            int codePoint;
+            int bytes = decodeChar(t->from, data + pos, len - pos, &codePoint);
+            if (bytes == 0 && !final) {
+                break; // cut off; finish it with the next block
+            }
+            if (bytes <= 0) {
+                fail(t, t->offset + pos, "invalid input");
+                return -1;
+            }
+            int size = encodeChar(t->to, codePoint, t->out + written);
+            if (size < 0) {
+                fail(t, t->offset + pos, "character not representable in the output encoding");
+                return -1;
+            }
+            written += size;
+            pos += bytes;
+        }
+        fwrite(t->out, 1, written, output);
+        return (long)pos;
+    }
+    }
+    return -1;
+}
+
+// part of a mapped file checked or counted by one thread
+typedef struct {
+    toolState state;
+    const unsigned char *data;
+    size_t start;
+    size_t end;
+} mappedPart;
+
+// helper function to check or count one part of a mapped file
+void *runPart(void *arg) {
+    mappedPart *part = (mappedPart *)arg;
+    size_t pos = part->start;
+
+    part->state.offset = pos;
+    while (pos < part->end) {
+        size_t len = (part->end - pos < BLOCK_SIZE) ? part->end - pos : BLOCK_SIZE;
+        long used = processBlock(&part->state, part->data + pos, len, pos + len == part->end, NULL);
+        if (used < 0) {
+            break;
+        }
+        pos += used;
+        part->state.offset = pos;
+    }
+    return NULL;
+}
+
+// helper function to run the command over a memory-mapped input
+int runMapped(toolState *t, const unsigned char *data, size_t size, int threads, FILE *output) {
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    int splittable = (t->command == CMD_CHECK || t->command == CMD_STRLEN);
+    if (!splittable || threads <= 1 || size < PARALLEL_MIN) {
+        // one block at a time; the file is contiguous, so a cut off character
+        // is simply read again at the start of the next block
+        size_t pos = 0;
+        while (pos < size) {
+            size_t len = (size - pos < BLOCK_SIZE) ? size - pos : BLOCK_SIZE;
+            long used = processBlock(t, data + pos, len, pos + len == size, output);
+            if (used < 0) {
+                return -1;
+            }
+            pos += used;
+            t->offset = pos;
+        }
+        return 0;
+    }
+
+    mappedPart *parts = (mappedPart*)calloc(threads, sizeof(mappedPart));
+    pthread_t *ids = (pthread_t*)calloc(threads, sizeof(pthread_t));
+    int *started = (int*)calloc(threads, sizeof(int));
+    if (parts == NULL || ids == NULL || started == NULL) {
+        free(parts);
+        free(ids);
+        free(started);
+        return -1;
+    }
+
+    // split the file into equal parts, moving each split to a character start
+    size_t start = 0;
+    for (int k = 0; k < threads; ++k) {
+        size_t end = (k == threads - 1) ? size : size / threads * (k + 1);
+        for (int back = 0; back < 3 && end < size && (data[end] & 0xC0) == 0x80; ++back) {
+            end++;
+        }
+        if (end < start) {
+            end = start;
+        }
+        parts[k].state = *t;
+        parts[k].state.out = NULL;
+        parts[k].data = data;
+        parts[k].start = start;
+        parts[k].end = end;
+        start = end;
+    }
+    for (int k = 1; k < threads; ++k) {
+        started[k] = (pthread_create(&ids[k], NULL, runPart, &parts[k]) == 0);
+    }
+    runPart(&parts[0]);
+
+    // combine the results: counts add up, and the first error wins
+    for (int k = 0; k < threads; ++k) {
+        if (k > 0 && started[k]) {
+            pthread_join(ids[k], NULL);
+        }
+        else if (k > 0) {
+            runPart(&parts[k]);
+        }
+        t->count += parts[k].state.count;
+        if (parts[k].state.errorAt >= 0) {
+            fail(t, (unsigned long long)parts[k].state.errorAt, parts[k].state.error);
+        }
+    }
+    t->offset = size;
+
+    free(parts);
+    free(ids);
+    free(started);
+    return (t->errorAt >= 0) ? -1 : 0;
+}
+
+// reader thread state: two buffers that the reader fills while the command
+// works on the other one
+typedef struct {
+    int fd;
+    unsigned char *buffers[2]; // CARRY_ROOM bytes of room, then the data
+    size_t lengths[2];         // bytes read into each buffer (0 at the end)
+    int filled[2];             // 1 while a buffer belongs to the command
+    int error;                 // 1 if a read failed
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} streamReader;
+
+// helper function to release the reader's lock if the thread is cancelled
+// while it waits (pthread_cond_wait takes the lock again before it stops)
+void unlockReader(void *lock) {
+    pthread_mutex_unlock((pthread_mutex_t *)lock);
+}
+
+// helper function for the reader to wait until the command is done with a
+// buffer. Returns with the lock held.
+void waitForEmpty(streamReader *r, int which) {
+    pthread_mutex_lock(&r->lock);
+    pthread_cleanup_push(unlockReader, &r->lock);
+    while (r->filled[which]) {
+        pthread_cond_wait(&r->changed, &r->lock);
+    }
+    pthread_cleanup_pop(0);
+}
+
+// helper function that fills the buffers from the input, taking turns
+void *readStream(void *arg) {
+    streamReader *r = (streamReader *)arg;
+
+    for (int which = 0; ; which ^= 1) {
+        // wait until the command is done with this buffer
+        waitForEmpty(r, which);
+        pthread_mutex_unlock(&r->lock);
+
+        // fill the buffer (pipes return a little at a time)
+        size_t len = 0;
+        while (len < BLOCK_SIZE) {
+            ssize_t n = read(r->fd, r->buffers[which] + CARRY_ROOM + len, BLOCK_SIZE - len);
+            if (n <= 0) {
+                r->error = (n < 0);
+                break;
+            }
+            len += (size_t)n;
+        }
+
+        pthread_mutex_lock(&r->lock);
+        r->lengths[which] = len;
+        r->filled[which] = 1;
+        pthread_cond_broadcast(&r->changed);
+        pthread_mutex_unlock(&r->lock);
+
+        if (len < BLOCK_SIZE) {
+            // end of input (or an error): the command sees an empty buffer next
+            if (len > 0) {
+                which ^= 1;
+                waitForEmpty(r, which);
+                r->lengths[which] = 0;
+                r->filled[which] = 1;
+                pthread_cond_broadcast(&r->changed);
+                pthread_mutex_unlock(&r->lock);
+            }
+            return NULL;
+        }
+    }
+}
+
+// helper function to run the command over a stream (pipe or terminal)
+int runStream(toolState *t, int fd, FILE *output, unsigned long long *total) {
+    streamReader r;
+    memset(&r, 0, sizeof(r));
+    r.fd = fd;
+    r.buffers[0] = (unsigned char*)malloc(CARRY_ROOM + BLOCK_SIZE);
+    r.buffers[1] = (unsigned char*)malloc(CARRY_ROOM + BLOCK_SIZE);
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_cond_init(&r.changed, NULL);
+
+    pthread_t reader;
+    if (r.buffers[0] == NULL || r.buffers[1] == NULL ||
+        pthread_create(&reader, NULL, readStream, &r) != 0) {
+        free(r.buffers[0]);
+        free(r.buffers[1]);
+        return -1;
+    }
+
+    unsigned char carry[CARRY_ROOM]; // cut off character from the last block
+    size_t carried = 0;
+    int status = 0;
+
+    for (int which = 0; ; which ^= 1) {
+        pthread_mutex_lock(&r.lock);
+        while (!r.filled[which]) {
+            pthread_cond_wait(&r.changed, &r.lock);
+        }
+        pthread_mutex_unlock(&r.lock);
+
+        // put the carried bytes right in front of the new data
+        size_t len = r.lengths[which];
+        int final = (len == 0);
+        unsigned char *data = r.buffers[which] + CARRY_ROOM - carried;
+        memcpy(data, carry, carried);
+        *total += len;
+
+        long used = processBlock(t, data, carried + len, final, output);
+        if (used < 0) {
+            status = -1;
+        }
+        else {
+            carried = carried + len - used;
+            memcpy(carry, data + used, carried);
+            t->offset += used;
+        }
+
+        pthread_mutex_lock(&r.lock);
+        r.filled[which] = 0;
+        pthread_cond_broadcast(&r.changed);
+        pthread_mutex_unlock(&r.lock);
+
+        if (final || status != 0) {
+            break;
+        }
+    }
+
+    if (status != 0) {
+        pthread_cancel(reader); // stop reading input nobody will look at
+    }
+    pthread_join(reader, NULL);
+    if (r.error) {
+        status = -1;
+    }
+
+    pthread_mutex_destroy(&r.lock);
+    pthread_cond_destroy(&r.changed);
+    free(r.buffers[0]);
+    free(r.buffers[1]);
+    return status;
+}
+
+// helper function to look up an encoding name for transcode
+int parseEncoding(const char *name) {
+    static const struct { const char *name; int enc; } names[] = {
+        {"utf-8", ENC_UTF8}, {"utf8", ENC_UTF8},
+        {"utf-16le", ENC_UTF16LE}, {"utf16le", ENC_UTF16LE},
+        {"utf-16be", ENC_UTF16BE}, {"utf16be", ENC_UTF16BE},
+        {"utf-32le", ENC_UTF32LE}, {"utf32le", ENC_UTF32LE},
+        {"utf-32be", ENC_UTF32BE}, {"utf32be", ENC_UTF32BE},
+        {"latin1", ENC_LATIN1}, {"iso-8859-1", ENC_LATIN1}
+    };
+    for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); ++k) {
+        if (strcasecmp(name, names[k].name) == 0) {
+            return names[k].enc;
+        }
+    }
+    return -1;
+}
+
+void usage(void) {
+    fprintf(stderr,
+            "usage: utf8tool [-j threads] [-q] command [file]\n"
+            "commands:\n"
+            "  check              validate the input\n"
+            "  strlen             count the characters in the input\n"
+            "  sanitize           replace invalid bytes with U+FFFD\n"
+            "  escape             write non-ASCII characters as \\uXXXX\n"
+            "  unescape           turn \\uXXXX sequences back into UTF-8\n"
+            "  transcode FROM TO  convert between utf-8, utf-16le, utf-16be,\n"
+            "                     utf-32le, utf-32be and latin1\n");
+}
+
+int main(int argc, char **argv) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = (processors > 0) ? (int)processors : 1;
+    int quiet = 0;
+    int arg = 1;
+
+    // options
+    while (arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0') {
+        if (strcmp(argv[arg], "-q") == 0) {
+            quiet = 1;
+            arg++;
+        }
+        else if (strncmp(argv[arg], "-j", 2) == 0 && (argv[arg][2] != '\0' || arg + 1 < argc)) {
+            // -j N or -jN
+            threads = atoi((argv[arg][2] != '\0') ? argv[arg] + 2 : argv[arg + 1]);
+            if (threads < 1) {
+                threads = 1;
+            }
+            arg += (argv[arg][2] != '\0') ? 1 : 2;
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (arg >= argc) {
+        usage();
+        return 2;
+    }
+
+    // command
+    toolState t;
+    memset(&t, 0, sizeof(t));
+    t.errorAt = -1;
+    const char *name = argv[arg++];
+    if (strcmp(name, "check") == 0) {
+        t.command = CMD_CHECK;
+    }
+    else if (strcmp(name, "strlen") == 0) {
+        t.command = CMD_STRLEN;
+    }
+    else if (strcmp(name, "sanitize") == 0) {
+        t.command = CMD_SANITIZE;
+    }
+    else if (strcmp(name, "escape") == 0) {
+        t.command = CMD_ESCAPE;
+    }
+    else if (strcmp(name, "unescape") == 0) {
+        t.command = CMD_UNESCAPE;
+    }
+    else if (strcmp(name, "transcode") == 0 && arg + 1 < argc) {
+        t.command = CMD_TRANSCODE;
+        t.from = parseEncoding(argv[arg]);
+        t.to = parseEncoding(argv[arg + 1]);
+        if (t.from < 0 || t.to < 0) {
+            fprintf(stderr, "utf8tool: unknown encoding\n");
+            return 2;
+        }
+        arg += 2;
+    }
+    else {
+        usage();
+        return 2;
+    }
+
+    // input
+    const char *path = (arg < argc) ? argv[arg] : "-";
+    int fd = (strcmp(path, "-") == 0) ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 2;
+    }
+
+    static char outputBuffer[1 << 20];
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+    struct timespec begin;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    unsigned long long total = 0;
+    int status;
+    struct stat info;
+    // stdin may already have been read from (for example "(head -c 10;
+    // utf8tool check) < file"), so start at the current offset; mmap needs
+    // an offset that is a multiple of the page size
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && start >= 0 && info.st_size > start) {
+        off_t mapStart = start - start % sysconf(_SC_PAGESIZE);
+        size_t mapSize = (size_t)(info.st_size - mapStart);
+        total = (unsigned long long)(info.st_size - start);
+        void *map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, mapStart);
+        if (map == MAP_FAILED) {
+            perror(path);
+            return 2;
+        }
+        status = runMapped(&t, (const unsigned char *)map + (start - mapStart), (size_t)total, threads, stdout);
+        munmap(map, mapSize);
+        lseek(fd, 0, SEEK_END); // leave the offset where reading would
+    }
+    else {
+        status = runStream(&t, fd, stdout, &total);
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    // results
+    int exitCode = 0;
+    if (t.errorAt >= 0) {
+        if (t.command == CMD_CHECK) {
+            printf("invalid: %s at byte %lld\n", t.error, t.errorAt);
+        }
+        else {
+            fflush(stdout);
+            fprintf(stderr, "utf8tool: %s at byte %lld\n", t.error, t.errorAt);
+        }
+        exitCode = 1;
+    }
+    else if (status != 0) {
+        fflush(stdout);
+        fprintf(stderr, "utf8tool: %s: read or memory error\n", path);
+        exitCode = 2;
+    }
+    else if (t.command == CMD_CHECK) {
+        printf("valid\n");
+    }
+    else if (t.command == CMD_STRLEN) {
+        printf("%llu\n", t.count);
+    }
+    fflush(stdout);
+
+    if (!quiet) {
+        double megabytes = total / 1e6;
+        fprintf(stderr, "utf8tool: %s: %.1f MB in %.3f s (%.1f MB/s)\n", name, megabytes, seconds,
+                (seconds > 0) ? megabytes / seconds : 0.0);
+    }
+
+    free(t.out);
+    return exitCode;
+}